@@ -49,6 +49,10 @@
 #include <locale.h>
 #endif
 
+#ifdef CJSON_NODE_SLAB
+#include <stdatomic.h>
+#endif
+
 #if defined(_MSC_VER)
 #pragma warning (pop)
 #endif
@@ -77,6 +81,14 @@
 #define isnan(d) (d != d)
 #endif
 
+#if defined(_MSC_VER)
+#define CJSON_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define CJSON_THREAD_LOCAL _Thread_local
+#else
+#define CJSON_THREAD_LOCAL __thread
+#endif
+
 #ifndef NAN
 #ifdef _WIN32
 #define NAN sqrt(-1.0)
@@ -88,8 +100,10 @@
 typedef struct {
     const unsigned char *json;
     size_t position;
+    const char *reason;
 } error;
-static error global_error = { NULL, 0 };
+/* last error of cJSON_Parse* in the calling thread */
+static CJSON_THREAD_LOCAL error global_error = { NULL, 0, NULL };
 
 CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void)
 {
@@ -206,6 +220,79 @@ static unsigned char* cJSON_strdup(const unsigned char* string, const internal_h
     return copy;
 }
 
+#ifdef CJSON_COMPACT_NODES
+/* valuestring shares its storage with valuedouble, it is only valid for these types */
+#define has_valuestring(item) (((item)->type & (cJSON_String | cJSON_Raw)) != 0)
+/* is the string stored inside the node itself */
+#define is_inline(item, pointer) (((const char*)(pointer) >= (item)->inline_strings) && ((const char*)(pointer) < ((item)->inline_strings + CJSON_INLINE_SIZE)))
+#else
+#define has_valuestring(item) true
+#define is_inline(item, pointer) ((void)(item), false)
+#endif
+
+/* size bytes of storage inside the node, behind the strings already stored there. NULL if they don't fit. */
+static unsigned char *inline_storage(cJSON * const item, size_t size)
+{
+#ifdef CJSON_COMPACT_NODES
+    size_t used = 0;
+    size_t end = 0;
+
+    if ((item->string != NULL) && is_inline(item, item->string))
+    {
+        used = (size_t)(item->string - item->inline_strings) + strlen(item->string) + sizeof("");
+    }
+    if (has_valuestring(item) && (item->valuestring != NULL) && is_inline(item, item->valuestring))
+    {
+        end = (size_t)(item->valuestring - item->inline_strings) + strlen(item->valuestring) + sizeof("");
+        used = (end > used) ? end : used;
+    }
+    if (size <= (CJSON_INLINE_SIZE - used))
+    {
+        return (unsigned char*)item->inline_strings + used;
+    }
+#else
+    (void)item;
+    (void)size;
+#endif
+
+    return NULL;
+}
+
+/* copy a string for the node, inside it when it fits */
+static unsigned char* node_strdup(cJSON * const item, const unsigned char* string, const internal_hooks * const hooks)
+{
+#ifdef CJSON_COMPACT_NODES
+    size_t length = 0;
+    unsigned char *copy = NULL;
+
+    if (string == NULL)
+    {
+        return NULL;
+    }
+
+    length = strlen((const char*)string) + sizeof("");
+    copy = inline_storage(item, length);
+    if (copy != NULL)
+    {
+        memcpy(copy, string, length);
+        return copy;
+    }
+#else
+    (void)item;
+#endif
+
+    return cJSON_strdup(string, hooks);
+}
+
+/* free a string of the node unless it is stored inside it */
+static void free_node_string(const cJSON * const item, char *string, const internal_hooks * const hooks)
+{
+    if ((string != NULL) && !is_inline(item, string))
+    {
+        hooks->deallocate(string);
+    }
+}
+
 CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
 {
     if (hooks == NULL)
@@ -237,10 +324,163 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     }
 }
 
+#ifdef CJSON_NODE_SLAB
+/* Node slab allocator: nodes are carved from blocks of CJSON_SLAB_BLOCK_NODES obtained from the
+ * allocate hook and recycled through a free list per thread, so building and deleting trees
+ * doesn't go through malloc for every node. Freed trees are handed back in one piece. When a
+ * thread caches more than CJSON_SLAB_CACHE_MAX free nodes, the chain is moved to a shared depot
+ * where other threads refill from. Blocks are never returned, the memory stays at the peak. */
+#ifndef CJSON_SLAB_BLOCK_NODES
+#define CJSON_SLAB_BLOCK_NODES 256
+#endif
+
+#ifndef CJSON_SLAB_CACHE_MAX
+#define CJSON_SLAB_CACHE_MAX 4096
+#endif
+
+/* chain of free nodes linked through next */
+typedef struct
+{
+    cJSON *head;
+    cJSON *tail;
+    size_t count;
+} node_chain;
+
+static CJSON_THREAD_LOCAL node_chain slab_cache = { NULL, NULL, 0 };
+
+/* chains released by threads with a full cache, linked through the child pointer of their head,
+ * which also keeps the tail in prev and the chain length in valueint */
+static cJSON *slab_depot = NULL;
+static atomic_flag slab_depot_lock = ATOMIC_FLAG_INIT;
+
+static void slab_depot_acquire(void)
+{
+    while (atomic_flag_test_and_set_explicit(&slab_depot_lock, memory_order_acquire))
+    {
+    }
+}
+
+static void slab_depot_release(void)
+{
+    atomic_flag_clear_explicit(&slab_depot_lock, memory_order_release);
+}
+
+static void slab_depot_push(const node_chain * const chain)
+{
+    chain->head->prev = chain->tail;
+    chain->head->valueint = (int)chain->count;
+    slab_depot_acquire();
+    chain->head->child = slab_depot;
+    slab_depot = chain->head;
+    slab_depot_release();
+}
+
+static cJSON_bool slab_refill(const internal_hooks * const hooks)
+{
+    cJSON *batch = NULL;
+    cJSON *block = NULL;
+    size_t index = 0;
+
+    slab_depot_acquire();
+    batch = slab_depot;
+    if (batch != NULL)
+    {
+        slab_depot = batch->child;
+    }
+    slab_depot_release();
+
+    if (batch != NULL)
+    {
+        slab_cache.head = batch;
+        slab_cache.tail = batch->prev;
+        slab_cache.count = (size_t)batch->valueint;
+        return true;
+    }
+
+    block = (cJSON*)hooks->allocate(sizeof(cJSON) * CJSON_SLAB_BLOCK_NODES);
+    if (block == NULL)
+    {
+        return false;
+    }
+    for (index = 0; index < (CJSON_SLAB_BLOCK_NODES - 1); index++)
+    {
+        block[index].next = &block[index + 1];
+    }
+    block[CJSON_SLAB_BLOCK_NODES - 1].next = NULL;
+    slab_cache.head = block;
+    slab_cache.tail = &block[CJSON_SLAB_BLOCK_NODES - 1];
+    slab_cache.count = CJSON_SLAB_BLOCK_NODES;
+
+    return true;
+}
+
+static cJSON *slab_alloc(const internal_hooks * const hooks)
+{
+    cJSON *node = NULL;
+
+    if ((slab_cache.head == NULL) && !slab_refill(hooks))
+    {
+        return NULL;
+    }
+
+    node = slab_cache.head;
+    slab_cache.head = node->next;
+    slab_cache.count--;
+    if (slab_cache.head == NULL)
+    {
+        slab_cache.tail = NULL;
+    }
+
+    return node;
+}
+
+/* return the nodes of a deleted tree in one go */
+static void slab_release(const node_chain * const freed)
+{
+    if (freed->head == NULL)
+    {
+        return;
+    }
+
+    if ((slab_cache.count + freed->count) > CJSON_SLAB_CACHE_MAX)
+    {
+        slab_depot_push(freed);
+        return;
+    }
+
+    if (slab_cache.head == NULL)
+    {
+        slab_cache = *freed;
+        return;
+    }
+
+    slab_cache.tail->next = freed->head;
+    slab_cache.tail = freed->tail;
+    slab_cache.count += freed->count;
+}
+#endif /* CJSON_NODE_SLAB */
+
+CJSON_PUBLIC(void) cJSON_ReleaseThreadCache(void)
+{
+#ifdef CJSON_NODE_SLAB
+    if (slab_cache.head != NULL)
+    {
+        slab_depot_push(&slab_cache);
+    }
+    slab_cache.head = NULL;
+    slab_cache.tail = NULL;
+    slab_cache.count = 0;
+#endif
+}
+
 /* Internal constructor. */
 static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
 {
+#ifdef CJSON_NODE_SLAB
+    cJSON* node = slab_alloc(hooks);
+#else
     cJSON* node = (cJSON*)hooks->allocate(sizeof(cJSON));
+#endif
     if (node)
     {
         memset(node, '\0', sizeof(cJSON));
@@ -249,32 +489,60 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+/* Free the nodes of a chain and all their children. With the slab allocator the nodes are
+ * collected in freed instead, to be released together. */
+static void delete_items(cJSON *item, void * const freed)
 {
     cJSON *next = NULL;
+#ifdef CJSON_NODE_SLAB
+    node_chain * const chain = (node_chain*)freed;
+#else
+    (void)freed;
+#endif
     while (item != NULL)
     {
         next = item->next;
         if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
-            cJSON_Delete(item->child);
+            delete_items(item->child, freed);
         }
-        if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
+        if (!(item->type & cJSON_IsReference) && has_valuestring(item) && (item->valuestring != NULL))
         {
-            global_hooks.deallocate(item->valuestring);
+            free_node_string(item, item->valuestring, &global_hooks);
             item->valuestring = NULL;
         }
         if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
         {
-            global_hooks.deallocate(item->string);
+            free_node_string(item, item->string, &global_hooks);
             item->string = NULL;
         }
+#ifdef CJSON_NODE_SLAB
+        item->next = chain->head;
+        if (chain->head == NULL)
+        {
+            chain->tail = item;
+        }
+        chain->head = item;
+        chain->count++;
+#else
         global_hooks.deallocate(item);
+#endif
         item = next;
     }
 }
 
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+{
+#ifdef CJSON_NODE_SLAB
+    node_chain freed = { NULL, NULL, 0 };
+    delete_items(item, &freed);
+    slab_release(&freed);
+#else
+    delete_items(item, NULL);
+#endif
+}
+
 /* get the decimal point character of the current locale */
 static unsigned char get_decimal_point(void)
 {
@@ -293,8 +561,24 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    const char *error; /* why parsing failed, NULL until it does */
+    size_t error_offset; /* the first byte that is not valid JSON, length at the end of the input */
 } parse_buffer;
 
+/* record the reason and position of a parse failure, keeping the innermost one */
+#define parse_error_at(buffer, position, reason) \
+    do \
+    { \
+        if ((buffer)->error == NULL) \
+        { \
+            (buffer)->error = (reason); \
+            (buffer)->error_offset = (position); \
+        } \
+    } while (0)
+#define parse_error(buffer, reason) parse_error_at(buffer, (buffer)->offset, reason)
+/* the input ended where more was expected */
+#define parse_end_error(buffer) parse_error_at(buffer, (buffer)->length, "unexpected end of input")
+
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
 #define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
 /* check if the buffer can be accessed at the given index (starting with 0) */
@@ -303,6 +587,12 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+/* check if only whitespace is left: buffer_skip_whitespace stops on the last byte of the buffer */
+static cJSON_bool buffer_at_end(const parse_buffer * const buffer)
+{
+    return cannot_access_at_index(buffer, 0) || (((buffer->offset + 1) == buffer->length) && (buffer_at_offset(buffer)[0] <= 32));
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -357,6 +647,7 @@ loop_end:
     number_c_string = (unsigned char *) input_buffer->hooks.allocate(number_string_length + 1);
     if (number_c_string == NULL)
     {
+        parse_error(input_buffer, "out of memory");
         return false; /* allocation failure */
     }
 
@@ -380,6 +671,7 @@ loop_end:
     {
         /* free the temporary buffer */
         input_buffer->hooks.deallocate(number_c_string);
+        parse_error(input_buffer, "invalid number");
         return false; /* parse_error */
     }
 
@@ -410,6 +702,14 @@ loop_end:
 /* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
 {
+#ifdef CJSON_COMPACT_NODES
+    /* valuedouble would overwrite valuestring */
+    if (has_valuestring(object))
+    {
+        return number;
+    }
+#endif
+
     if (number >= INT_MAX)
     {
         object->valueint = INT_MAX;
@@ -456,14 +756,14 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
         strcpy(object->valuestring, valuestring);
         return object->valuestring;
     }
-    copy = (char*) cJSON_strdup((const unsigned char*)valuestring, &global_hooks);
+    copy = (char*) node_strdup(object, (const unsigned char*)valuestring, &global_hooks);
     if (copy == NULL)
     {
         return NULL;
     }
     if (object->valuestring != NULL)
     {
-        cJSON_free(object->valuestring);
+        free_node_string(object, object->valuestring, &global_hooks);
     }
     object->valuestring = copy;
 
@@ -479,6 +779,8 @@ typedef struct
     cJSON_bool noalloc;
     cJSON_bool format; /* is this print a formatted print */
     internal_hooks hooks;
+    cJSON_PrintFlush flush; /* empties the buffer instead of growing it, for cJSON_PrintStreamed */
+    void *flush_context;
 } printbuffer;
 
 /* realloc printbuffer if necessary to have at least "needed" bytes more */
@@ -504,6 +806,16 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         return NULL;
     }
 
+    if ((p->flush != NULL) && (p->offset > 0) && (needed + p->offset + 1 > p->length))
+    {
+        /* the printed text is never looked at again, hand it over */
+        if (!p->flush((const char*)p->buffer, p->offset, false, p->flush_context))
+        {
+            return NULL;
+        }
+        p->offset = 0;
+    }
+
     needed += p->offset + 1;
     if (needed <= p->length)
     {
@@ -824,8 +1136,14 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     unsigned char *output = NULL;
 
     /* not a string */
+    if (buffer_at_end(input_buffer))
+    {
+        parse_end_error(input_buffer);
+        goto fail;
+    }
     if (buffer_at_offset(input_buffer)[0] != '\"')
     {
+        parse_error(input_buffer, "expected string");
         goto fail;
     }
 
@@ -841,6 +1159,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
                 if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
                 {
                     /* prevent buffer overflow when last input character is a backslash */
+                    parse_end_error(input_buffer);
                     goto fail;
                 }
                 skipped_bytes++;
@@ -850,14 +1169,20 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         }
         if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
         {
+            parse_end_error(input_buffer);
             goto fail; /* string ended unexpectedly */
         }
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        output = inline_storage(item, allocation_length + sizeof(""));
+        if (output == NULL)
+        {
+            output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        }
         if (output == NULL)
         {
+            parse_error(input_buffer, "out of memory");
             goto fail; /* allocation failure */
         }
     }
@@ -908,11 +1233,13 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
                     if (sequence_length == 0)
                     {
                         /* failed to convert UTF16-literal to UTF-8 */
+                        parse_error_at(input_buffer, (size_t)(input_pointer - input_buffer->content), "invalid unicode escape");
                         goto fail;
                     }
                     break;
 
                 default:
+                    parse_error_at(input_buffer, (size_t)(input_pointer - input_buffer->content), "invalid escape sequence");
                     goto fail;
             }
             input_pointer += sequence_length;
@@ -933,7 +1260,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 fail:
     if (output != NULL)
     {
-        input_buffer->hooks.deallocate(output);
+        free_node_string(item, (char*)output, &input_buffer->hooks);
         output = NULL;
     }
 
@@ -1138,18 +1465,20 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
     return cJSON_ParseWithLengthOpts(value, buffer_length, return_parse_end, require_null_terminated);
 }
 
-/* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+/* Parse an object - create a new root, and populate. The failure position and reason go to error. */
+static cJSON *parse_with_length(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, error * const parse_failure)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, NULL, 0 };
     cJSON *item = NULL;
 
     /* reset error position */
-    global_error.json = NULL;
-    global_error.position = 0;
+    parse_failure->json = NULL;
+    parse_failure->position = 0;
+    parse_failure->reason = NULL;
 
     if (value == NULL || 0 == buffer_length)
     {
+        parse_error(&buffer, "empty input");
         goto fail;
     }
 
@@ -1161,21 +1490,30 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     item = cJSON_New_Item(&global_hooks);
     if (item == NULL) /* memory fail */
     {
+        parse_error(&buffer, "out of memory");
         goto fail;
     }
 
-    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    if (buffer_at_end(buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    {
+        parse_error_at(&buffer, buffer.length, "empty input");
+        goto fail;
+    }
+
+    if (!parse_value(item, &buffer))
     {
         /* parse failure. ep is set. */
         goto fail;
     }
 
-    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
+    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator
+     * or the end of the buffer (whitespace and null characters are skipped alike) */
     if (require_null_terminated)
     {
         buffer_skip_whitespace(&buffer);
-        if ((buffer.offset >= buffer.length) || buffer_at_offset(&buffer)[0] != '\0')
+        if (!buffer_at_end(&buffer))
         {
+            parse_error(&buffer, "trailing characters");
             goto fail;
         }
     }
@@ -1192,30 +1530,53 @@ fail:
         cJSON_Delete(item);
     }
 
+    /* the position is the first byte that is not valid JSON, buffer_length when the input ended early */
+    parse_failure->reason = buffer.error;
     if (value != NULL)
     {
-        error local_error;
-        local_error.json = (const unsigned char*)value;
-        local_error.position = 0;
+        parse_failure->json = (const unsigned char*)value;
+        parse_failure->position = (buffer.error != NULL) ? buffer.error_offset : buffer.offset;
+    }
 
-        if (buffer.offset < buffer.length)
-        {
-            local_error.position = buffer.offset;
-        }
-        else if (buffer.length > 0)
+    return NULL;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    error local_error = { NULL, 0, NULL };
+    cJSON *item = parse_with_length(value, buffer_length, return_parse_end, require_null_terminated, &local_error);
+
+    if ((item == NULL) && (local_error.json != NULL))
+    {
+        /* point at the last byte of the buffer rather than after it */
+        if ((local_error.position >= buffer_length) && (buffer_length > 0))
         {
-            local_error.position = buffer.length - 1;
+            local_error.position = buffer_length - 1;
         }
 
         if (return_parse_end != NULL)
         {
             *return_parse_end = (const char*)local_error.json + local_error.position;
         }
+    }
+    global_error = local_error;
+
+    return item;
+}
 
-        global_error = local_error;
+/* Only whitespace may follow the value, as with the stream (see cJSON_StreamFeed) */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithError(const char *value, size_t buffer_length, cJSON_ParseError *parse_failure)
+{
+    error local_error = { NULL, 0, NULL };
+    cJSON *item = parse_with_length(value, buffer_length, NULL, true, &local_error);
+
+    if (parse_failure != NULL)
+    {
+        parse_failure->offset = local_error.position;
+        parse_failure->reason = (item != NULL) ? NULL : ((local_error.reason != NULL) ? local_error.reason : "invalid JSON");
     }
 
-    return NULL;
+    return item;
 }
 
 /* Default options for cJSON_Parse */
@@ -1229,6 +1590,591 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
     return cJSON_ParseWithLengthOpts(value, buffer_length, 0, 0);
 }
 
+/* Incremental parser: the tree is built while chunks are fed. Objects and arrays are opened and
+ * closed as their brackets arrive and every member is attached as soon as it is complete, so no
+ * input is ever scanned twice. Only the string, number or literal being read is buffered (in a
+ * buffer whose capacity is kept across messages) and it is converted by the same routines as
+ * cJSON_Parse once its last byte has been seen. */
+#define STREAM_VALUE 0 /* before a value */
+#define STREAM_VALUE_OR_CLOSE 1 /* after '[' */
+#define STREAM_KEY 2 /* after ',' in an object */
+#define STREAM_KEY_OR_CLOSE 3 /* after '{' */
+#define STREAM_COLON 4 /* after a key */
+#define STREAM_NEXT 5 /* after a member, before ',' or the closing bracket */
+#define STREAM_STRING 6
+#define STREAM_STRING_ESCAPE 7
+#define STREAM_SCALAR 8 /* number or literal, ends at a delimiter */
+
+struct cJSON_Stream
+{
+    unsigned char *buffer; /* the token being read */
+    size_t length;
+    size_t capacity;
+    cJSON **stack; /* open objects and arrays, innermost last */
+    size_t depth;
+    size_t stack_capacity;
+    cJSON *root; /* value under construction */
+    cJSON *target; /* node the token is parsed into, NULL while reading an object key */
+    size_t max_length;
+    size_t offset; /* bytes consumed since the last reset */
+    size_t value_start; /* offset of the first byte of the value */
+    size_t token_start; /* offset of the first byte of the token */
+    int state;
+    int status;
+    cJSON_ParseError error;
+    cJSON *result;
+};
+
+static cJSON_bool add_item_to_array(cJSON *array, cJSON *item);
+
+CJSON_PUBLIC(cJSON_Stream *) cJSON_StreamCreate(size_t max_length)
+{
+    cJSON_Stream *stream = (cJSON_Stream*)global_hooks.allocate(sizeof(cJSON_Stream));
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+    memset(stream, '\0', sizeof(cJSON_Stream));
+    stream->max_length = max_length;
+
+    return stream;
+}
+
+CJSON_PUBLIC(void) cJSON_StreamReset(cJSON_Stream *stream)
+{
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    if (stream->result != NULL)
+    {
+        cJSON_Delete(stream->result);
+        stream->result = NULL;
+    }
+    if (stream->root != NULL)
+    {
+        cJSON_Delete(stream->root);
+        stream->root = NULL;
+    }
+    stream->target = NULL;
+    stream->length = 0;
+    stream->depth = 0;
+    stream->offset = 0;
+    stream->value_start = 0;
+    stream->token_start = 0;
+    stream->state = STREAM_VALUE;
+    stream->status = cJSON_StreamNeedMore;
+    stream->error.offset = 0;
+    stream->error.reason = NULL;
+}
+
+/* enter the error state and drop the partial tree, offset is counted from the first byte fed */
+static int stream_fail(cJSON_Stream * const stream, size_t offset, const char *reason)
+{
+    if (stream->root != NULL)
+    {
+        cJSON_Delete(stream->root);
+        stream->root = NULL;
+    }
+    stream->target = NULL;
+    stream->depth = 0;
+    stream->error.offset = offset;
+    stream->error.reason = (reason != NULL) ? reason : "invalid JSON";
+    stream->status = cJSON_StreamError;
+
+    return cJSON_StreamError;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamGetError(const cJSON_Stream *stream, cJSON_ParseError *parse_failure)
+{
+    if ((stream == NULL) || (stream->status != cJSON_StreamError))
+    {
+        return false;
+    }
+
+    if (parse_failure != NULL)
+    {
+        *parse_failure = stream->error;
+    }
+
+    return true;
+}
+
+CJSON_PUBLIC(void) cJSON_StreamDelete(cJSON_Stream *stream)
+{
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    cJSON_StreamReset(stream);
+    if (stream->buffer != NULL)
+    {
+        global_hooks.deallocate(stream->buffer);
+    }
+    if (stream->stack != NULL)
+    {
+        global_hooks.deallocate(stream->stack);
+    }
+    global_hooks.deallocate(stream);
+}
+
+/* grow an array of the stream to hold at least needed elements, doubling its size */
+static void *stream_grow(void *memory, size_t *capacity, size_t needed, size_t element_size, size_t used)
+{
+    size_t newsize = (*capacity > 0) ? *capacity : 16;
+    void *newmemory = NULL;
+
+    while (newsize < needed)
+    {
+        if (newsize > (((size_t)-1 / 2) / element_size))
+        {
+            return NULL;
+        }
+        newsize *= 2;
+    }
+
+    if (global_hooks.reallocate != NULL)
+    {
+        newmemory = global_hooks.reallocate(memory, newsize * element_size);
+        if (newmemory == NULL)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        newmemory = global_hooks.allocate(newsize * element_size);
+        if (newmemory == NULL)
+        {
+            return NULL;
+        }
+        if (memory != NULL)
+        {
+            memcpy(newmemory, memory, used * element_size);
+            global_hooks.deallocate(memory);
+        }
+    }
+    *capacity = newsize;
+
+    return newmemory;
+}
+
+/* append bytes to the token buffer */
+static cJSON_bool stream_append(cJSON_Stream * const stream, const unsigned char * const bytes, size_t length)
+{
+    unsigned char *newbuffer = NULL;
+
+    if (length == 0)
+    {
+        return true;
+    }
+
+    if ((stream->length + length) > stream->capacity)
+    {
+        newbuffer = (unsigned char*)stream_grow(stream->buffer, &stream->capacity, stream->length + length, sizeof(unsigned char), stream->length);
+        if (newbuffer == NULL)
+        {
+            return false;
+        }
+        stream->buffer = newbuffer;
+    }
+
+    memcpy(stream->buffer + stream->length, bytes, length);
+    stream->length += length;
+
+    return true;
+}
+
+/* what was expected instead of the character at the end of a member */
+static const char *stream_expected(const cJSON_Stream * const stream)
+{
+    if (stream->depth == 0)
+    {
+        return "trailing characters";
+    }
+
+    return (stream->stack[stream->depth - 1]->type == cJSON_Array) ? "expected ',' or ']'" : "expected ',' or '}'";
+}
+
+/* a value is complete: either the whole text or a member of the innermost container */
+static int stream_value_done(cJSON_Stream * const stream)
+{
+    if (stream->depth > 0)
+    {
+        stream->state = STREAM_NEXT;
+        return cJSON_StreamNeedMore;
+    }
+
+    stream->result = stream->root;
+    stream->root = NULL;
+    stream->status = cJSON_StreamComplete;
+
+    return cJSON_StreamComplete;
+}
+
+/* start a value with its first character, at offset in the fed input */
+static int stream_begin_value(cJSON_Stream * const stream, unsigned char character, size_t offset)
+{
+    cJSON *parent = (stream->depth > 0) ? stream->stack[stream->depth - 1] : NULL;
+    cJSON *item = NULL;
+    cJSON **newstack = NULL;
+
+    if ((character == ',') || (character == ']') || (character == '}'))
+    {
+        return stream_fail(stream, offset, "unexpected character");
+    }
+
+    if ((parent != NULL) && (parent->type == cJSON_Object))
+    {
+        /* the member was attached when its key was read */
+        item = parent->child->prev;
+    }
+    else
+    {
+        item = cJSON_New_Item(&global_hooks);
+        if (item == NULL)
+        {
+            return stream_fail(stream, offset, "out of memory");
+        }
+        if (parent != NULL)
+        {
+            add_item_to_array(parent, item);
+        }
+        else
+        {
+            stream->root = item;
+            stream->value_start = offset;
+        }
+    }
+
+    if ((character == '{') || (character == '['))
+    {
+        if (stream->depth >= CJSON_NESTING_LIMIT)
+        {
+            return stream_fail(stream, offset, "nesting too deep");
+        }
+        if (stream->depth == stream->stack_capacity)
+        {
+            newstack = (cJSON**)stream_grow(stream->stack, &stream->stack_capacity, stream->depth + 1, sizeof(cJSON*), stream->depth);
+            if (newstack == NULL)
+            {
+                return stream_fail(stream, offset, "out of memory");
+            }
+            stream->stack = newstack;
+        }
+        stream->stack[stream->depth++] = item;
+        item->type = (character == '{') ? cJSON_Object : cJSON_Array;
+        stream->state = (character == '{') ? STREAM_KEY_OR_CLOSE : STREAM_VALUE_OR_CLOSE;
+
+        return cJSON_StreamNeedMore;
+    }
+
+    stream->target = item;
+    stream->token_start = offset;
+    stream->length = 0;
+    stream->state = (character == '\"') ? STREAM_STRING : STREAM_SCALAR;
+    if (!stream_append(stream, &character, 1))
+    {
+        return stream_fail(stream, offset, "out of memory");
+    }
+
+    return cJSON_StreamNeedMore;
+}
+
+/* start an object key with its opening quote */
+static int stream_begin_key(cJSON_Stream * const stream, unsigned char character, size_t offset)
+{
+    if (character != '\"')
+    {
+        return stream_fail(stream, offset, "expected string");
+    }
+
+    stream->target = NULL;
+    stream->token_start = offset;
+    stream->length = 0;
+    stream->state = STREAM_STRING;
+    if (!stream_append(stream, &character, 1))
+    {
+        return stream_fail(stream, offset, "out of memory");
+    }
+
+    return cJSON_StreamNeedMore;
+}
+
+/* the token in the buffer is complete, convert it into its node */
+static int stream_end_token(cJSON_Stream * const stream)
+{
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, NULL, 0 };
+    cJSON *item = stream->target;
+
+    buffer.content = stream->buffer;
+    buffer.length = stream->length;
+    buffer.hooks = global_hooks;
+
+    if (item == NULL)
+    {
+        /* object key, attach the member right away so a failure frees it with the tree */
+        item = cJSON_New_Item(&global_hooks);
+        if (item == NULL)
+        {
+            return stream_fail(stream, stream->token_start, "out of memory");
+        }
+        add_item_to_array(stream->stack[stream->depth - 1], item);
+        if (!parse_string(item, &buffer))
+        {
+            return stream_fail(stream, stream->token_start + buffer.error_offset, buffer.error);
+        }
+
+        /* swap valuestring and string, because we parsed the name */
+        item->string = item->valuestring;
+        item->valuestring = NULL;
+        stream->state = STREAM_COLON;
+
+        return cJSON_StreamNeedMore;
+    }
+
+    stream->target = NULL;
+    if (!parse_value(item, &buffer))
+    {
+        return stream_fail(stream, stream->token_start + buffer.error_offset, buffer.error);
+    }
+    if (buffer.offset < buffer.length)
+    {
+        /* e.g. "truex" or "1.2.3" */
+        return stream_fail(stream, stream->token_start + buffer.offset, stream_expected(stream));
+    }
+
+    return stream_value_done(stream);
+}
+
+/* close the innermost container with its bracket */
+static int stream_close(cJSON_Stream * const stream, unsigned char character, size_t offset)
+{
+    const unsigned char bracket = (stream->stack[stream->depth - 1]->type == cJSON_Array) ? ']' : '}';
+
+    if (character != bracket)
+    {
+        return stream_fail(stream, offset, stream_expected(stream));
+    }
+    stream->depth--;
+
+    return stream_value_done(stream);
+}
+
+CJSON_PUBLIC(int) cJSON_StreamFeed(cJSON_Stream *stream, const char *chunk, size_t length, size_t *consumed)
+{
+    const unsigned char *input = (const unsigned char*)chunk;
+    size_t index = 0;
+    size_t end = length;
+    size_t start = 0;
+    int status = cJSON_StreamNeedMore;
+
+    if (consumed != NULL)
+    {
+        *consumed = 0;
+    }
+
+    if ((stream == NULL) || ((chunk == NULL) && (length > 0)))
+    {
+        return cJSON_StreamError;
+    }
+
+    if (stream->status != cJSON_StreamNeedMore)
+    {
+        return stream->status;
+    }
+
+    /* only read as far as max_length allows for the value */
+    if ((stream->root != NULL) && (stream->max_length > 0) && ((stream->max_length - (stream->offset - stream->value_start)) < length))
+    {
+        end = stream->max_length - (stream->offset - stream->value_start);
+    }
+
+    while ((status == cJSON_StreamNeedMore) && (index < end))
+    {
+        const unsigned char character = input[index];
+
+        switch (stream->state)
+        {
+            case STREAM_STRING:
+                /* jump to the closing quote or the next escape */
+                start = index;
+                while ((index < end) && (input[index] != '\"') && (input[index] != '\\'))
+                {
+                    index++;
+                }
+                if (index < end)
+                {
+                    stream->state = (input[index] == '\\') ? STREAM_STRING_ESCAPE : STREAM_STRING;
+                    index++;
+                }
+                if (!stream_append(stream, input + start, index - start))
+                {
+                    status = stream_fail(stream, stream->offset + index, "out of memory");
+                }
+                else if ((index > start) && (input[index - 1] == '\"') && (stream->state == STREAM_STRING))
+                {
+                    status = stream_end_token(stream);
+                }
+                break;
+
+            case STREAM_STRING_ESCAPE:
+                if (!stream_append(stream, input + index, 1))
+                {
+                    status = stream_fail(stream, stream->offset + index, "out of memory");
+                }
+                stream->state = STREAM_STRING;
+                index++;
+                break;
+
+            case STREAM_SCALAR:
+                /* the delimiter is not part of the value */
+                start = index;
+                while ((index < end) && (input[index] > 32) && (input[index] != ',') && (input[index] != ']') && (input[index] != '}'))
+                {
+                    index++;
+                }
+                if (!stream_append(stream, input + start, index - start))
+                {
+                    status = stream_fail(stream, stream->offset + index, "out of memory");
+                }
+                else if (index < end)
+                {
+                    status = stream_end_token(stream);
+                }
+                break;
+
+            default:
+                if (character <= 32)
+                {
+                    /* whitespace between tokens */
+                    index++;
+                    break;
+                }
+                if ((stream->root == NULL) && ((character == ',') || (character == ']') || (character == '}')))
+                {
+                    /* can't start a value, consume it so the caller can resynchronize */
+                    index++;
+                    status = stream_fail(stream, stream->offset + index - 1, "unexpected character");
+                    break;
+                }
+
+                switch (stream->state)
+                {
+                    case STREAM_VALUE_OR_CLOSE:
+                    case STREAM_KEY_OR_CLOSE:
+                        if ((character == ']') || (character == '}'))
+                        {
+                            status = stream_close(stream, character, stream->offset + index);
+                        }
+                        else if (stream->state == STREAM_KEY_OR_CLOSE)
+                        {
+                            status = stream_begin_key(stream, character, stream->offset + index);
+                        }
+                        else
+                        {
+                            status = stream_begin_value(stream, character, stream->offset + index);
+                        }
+                        break;
+
+                    case STREAM_KEY:
+                        status = stream_begin_key(stream, character, stream->offset + index);
+                        break;
+
+                    case STREAM_COLON:
+                        if (character == ':')
+                        {
+                            stream->state = STREAM_VALUE;
+                        }
+                        else
+                        {
+                            status = stream_fail(stream, stream->offset + index, "expected ':'");
+                        }
+                        break;
+
+                    case STREAM_NEXT:
+                        if (character == ',')
+                        {
+                            stream->state = (stream->stack[stream->depth - 1]->type == cJSON_Array) ? STREAM_VALUE : STREAM_KEY;
+                        }
+                        else
+                        {
+                            status = stream_close(stream, character, stream->offset + index);
+                        }
+                        break;
+
+                    default:
+                        if ((stream->root == NULL) && (stream->max_length > 0) && ((length - index) > stream->max_length))
+                        {
+                            end = index + stream->max_length;
+                        }
+                        status = stream_begin_value(stream, character, stream->offset + index);
+                        break;
+                }
+                index++;
+                break;
+        }
+    }
+
+    if ((status == cJSON_StreamNeedMore) && (end < length))
+    {
+        status = stream_fail(stream, stream->offset + index, "message too large");
+    }
+    stream->offset += index;
+    if (consumed != NULL)
+    {
+        *consumed = index;
+    }
+
+    return status;
+}
+
+CJSON_PUBLIC(int) cJSON_StreamFinish(cJSON_Stream *stream)
+{
+    if (stream == NULL)
+    {
+        return cJSON_StreamError;
+    }
+
+    if (stream->status != cJSON_StreamNeedMore)
+    {
+        return stream->status;
+    }
+
+    if (stream->root == NULL)
+    {
+        /* nothing but whitespace was fed */
+        return cJSON_StreamNeedMore;
+    }
+
+    if ((stream->state == STREAM_SCALAR) && (stream->depth == 0))
+    {
+        /* a top level number or literal ends with the input */
+        return stream_end_token(stream);
+    }
+
+    /* truncated object, array or string */
+    return stream_fail(stream, stream->offset, "unexpected end of input");
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_StreamTakeResult(cJSON_Stream *stream)
+{
+    cJSON *result = NULL;
+
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    result = stream->result;
+    stream->result = NULL;
+    cJSON_StreamReset(stream);
+
+    return result;
+}
+
 #define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
 
 static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
@@ -1311,7 +2257,7 @@ CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
 
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0 };
 
     if (prebuffer < 0)
     {
@@ -1342,7 +2288,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0 };
 
     if ((length < 0) || (buffer == NULL))
     {
@@ -1359,6 +2305,42 @@ CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, cons
     return print_value(item, &p);
 }
 
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, cJSON_bool format, size_t buffer_size, cJSON_PrintFlush flush, void *context)
+{
+    printbuffer p;
+    cJSON_bool printed = false;
+
+    if ((flush == NULL) || (buffer_size == 0) || (buffer_size > INT_MAX))
+    {
+        return false;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.buffer = (unsigned char*)global_hooks.allocate(buffer_size);
+    if (!p.buffer)
+    {
+        return false;
+    }
+    p.length = buffer_size;
+    p.format = format;
+    p.hooks = global_hooks;
+    p.flush = flush;
+    p.flush_context = context;
+
+    if (print_value(item, &p))
+    {
+        update_offset(&p);
+        printed = flush((const char*)p.buffer, p.offset, true, context);
+    }
+
+    /* ensure() frees the buffer when growing it failed */
+    if (p.buffer != NULL)
+    {
+        global_hooks.deallocate(p.buffer);
+    }
+    return printed;
+}
+
 /* Parser core - when encountering text, process appropriately. */
 static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -1411,6 +2393,14 @@ static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buf
         return parse_object(item, input_buffer);
     }
 
+    if (buffer_at_end(input_buffer))
+    {
+        parse_end_error(input_buffer);
+    }
+    else
+    {
+        parse_error(input_buffer, "unexpected character");
+    }
     return false;
 }
 
@@ -1496,6 +2486,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
 
     if (input_buffer->depth >= CJSON_NESTING_LIMIT)
     {
+        parse_error(input_buffer, "nesting too deep");
         return false; /* to deeply nested */
     }
     input_buffer->depth++;
@@ -1518,6 +2509,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
     if (cannot_access_at_index(input_buffer, 0))
     {
         input_buffer->offset--;
+        parse_end_error(input_buffer);
         goto fail;
     }
 
@@ -1530,6 +2522,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
         cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
         if (new_item == NULL)
         {
+            parse_error(input_buffer, "out of memory");
             goto fail; /* allocation failure */
         }
 
@@ -1560,6 +2553,14 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
 
     if (cannot_access_at_index(input_buffer, 0) || buffer_at_offset(input_buffer)[0] != ']')
     {
+        if (buffer_at_end(input_buffer))
+        {
+            parse_end_error(input_buffer);
+        }
+        else
+        {
+            parse_error(input_buffer, "expected ',' or ']'");
+        }
         goto fail; /* expected end of array */
     }
 
@@ -1656,6 +2657,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
 
     if (input_buffer->depth >= CJSON_NESTING_LIMIT)
     {
+        parse_error(input_buffer, "nesting too deep");
         return false; /* to deeply nested */
     }
     input_buffer->depth++;
@@ -1676,6 +2678,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
     if (cannot_access_at_index(input_buffer, 0))
     {
         input_buffer->offset--;
+        parse_end_error(input_buffer);
         goto fail;
     }
 
@@ -1688,6 +2691,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
         cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
         if (new_item == NULL)
         {
+            parse_error(input_buffer, "out of memory");
             goto fail; /* allocation failure */
         }
 
@@ -1707,6 +2711,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
 
         if (cannot_access_at_index(input_buffer, 1))
         {
+            parse_end_error(input_buffer);
             goto fail; /* nothing comes after the comma */
         }
 
@@ -1723,8 +2728,14 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
         current_item->string = current_item->valuestring;
         current_item->valuestring = NULL;
 
-        if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
+        if (buffer_at_end(input_buffer))
+        {
+            parse_end_error(input_buffer);
+            goto fail;
+        }
+        if (buffer_at_offset(input_buffer)[0] != ':')
         {
+            parse_error(input_buffer, "expected ':'");
             goto fail; /* invalid object */
         }
 
@@ -1741,6 +2752,14 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
 
     if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != '}'))
     {
+        if (buffer_at_end(input_buffer))
+        {
+            parse_end_error(input_buffer);
+        }
+        else
+        {
+            parse_error(input_buffer, "expected ',' or '}'");
+        }
         goto fail; /* expected end of object */
     }
 
@@ -2081,7 +3100,7 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
     }
     else
     {
-        new_key = (char*)cJSON_strdup((const unsigned char*)string, hooks);
+        new_key = (char*)node_strdup(item, (const unsigned char*)string, hooks);
         if (new_key == NULL)
         {
             return false;
@@ -2092,7 +3111,7 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
 
     if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
     {
-        hooks->deallocate(item->string);
+        free_node_string(item, item->string, hooks);
     }
 
     item->string = new_key;
@@ -2419,9 +3438,10 @@ static cJSON_bool replace_item_in_object(cJSON *object, const char *string, cJSO
     /* replace the name in the replacement */
     if (!(replacement->type & cJSON_StringIsConst) && (replacement->string != NULL))
     {
-        cJSON_free(replacement->string);
+        free_node_string(replacement, replacement->string, &global_hooks);
     }
-    replacement->string = (char*)cJSON_strdup((const unsigned char*)string, &global_hooks);
+    replacement->string = NULL;
+    replacement->string = (char*)node_strdup(replacement, (const unsigned char*)string, &global_hooks);
     if (replacement->string == NULL)
     {
         return false;
@@ -2519,7 +3539,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateString(const char *string)
     if(item)
     {
         item->type = cJSON_String;
-        item->valuestring = (char*)cJSON_strdup((const unsigned char*)string, &global_hooks);
+        item->valuestring = (char*)node_strdup(item, (const unsigned char*)string, &global_hooks);
         if(!item->valuestring)
         {
             cJSON_Delete(item);
@@ -2569,7 +3589,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateRaw(const char *raw)
     if(item)
     {
         item->type = cJSON_Raw;
-        item->valuestring = (char*)cJSON_strdup((const unsigned char*)raw, &global_hooks);
+        item->valuestring = (char*)node_strdup(item, (const unsigned char*)raw, &global_hooks);
         if(!item->valuestring)
         {
             cJSON_Delete(item);
@@ -2793,9 +3813,10 @@ cJSON * cJSON_Duplicate_rec(const cJSON *item, size_t depth, cJSON_bool recurse)
     newitem->type = item->type & (~cJSON_IsReference);
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
-    if (item->valuestring)
+    if (has_valuestring(item) && item->valuestring)
     {
-        newitem->valuestring = (char*)cJSON_strdup((unsigned char*)item->valuestring, &global_hooks);
+        newitem->valuestring = NULL;
+        newitem->valuestring = (char*)node_strdup(newitem, (unsigned char*)item->valuestring, &global_hooks);
         if (!newitem->valuestring)
         {
             goto fail;
@@ -2803,7 +3824,7 @@ cJSON * cJSON_Duplicate_rec(const cJSON *item, size_t depth, cJSON_bool recurse)
     }
     if (item->string)
     {
-        newitem->string = (item->type&cJSON_StringIsConst) ? item->string : (char*)cJSON_strdup((unsigned char*)item->string, &global_hooks);
+        newitem->string = (item->type&cJSON_StringIsConst) ? item->string : (char*)node_strdup(newitem, (unsigned char*)item->string, &global_hooks);
         if (!newitem->string)
         {
             goto fail;
@@ -100,6 +100,42 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 #define cJSON_StringIsConst 512
 
 /* The cJSON structure: */
+#ifdef CJSON_COMPACT_NODES
+/* Compact layout (needs C11 anonymous unions): valuestring and valuedouble share their storage, so valuestring
+ * must only be read for cJSON_String/cJSON_Raw items and valuedouble for cJSON_Number items, and short keys and
+ * string values are stored inside the node instead of separate allocations.
+ * With the default CJSON_INLINE_SIZE of 16 a node takes 64 bytes on 64 bit targets, key and value included. */
+#ifndef CJSON_INLINE_SIZE
+#define CJSON_INLINE_SIZE 16
+#endif
+typedef struct cJSON
+{
+    /* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
+    struct cJSON *next;
+    struct cJSON *prev;
+    /* An array or object item will have a child pointer pointing to a chain of the items in the array/object. */
+    struct cJSON *child;
+
+    /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
+    char *string;
+
+    union
+    {
+        /* The item's string, if type==cJSON_String  and type == cJSON_Raw */
+        char *valuestring;
+        /* The item's number, if type==cJSON_Number */
+        double valuedouble;
+    };
+
+    /* The type of the item, as above. */
+    int type;
+    /* writing to valueint is DEPRECATED, use cJSON_SetNumberValue instead */
+    int valueint;
+
+    /* storage for a short string and valuestring, don't use directly */
+    char inline_strings[CJSON_INLINE_SIZE];
+} cJSON;
+#else
 typedef struct cJSON
 {
     /* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
@@ -121,6 +157,7 @@ typedef struct cJSON
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
 } cJSON;
+#endif
 
 typedef struct cJSON_Hooks
 {
@@ -131,6 +168,14 @@ typedef struct cJSON_Hooks
 
 typedef int cJSON_bool;
 
+/* Position and static description of a parse failure. The offset is that of the first byte that is not valid JSON,
+ * or the length of the input when it ended early. cJSON_ParseWithError and cJSON_Stream report the same for the same text. */
+typedef struct cJSON_ParseError
+{
+    size_t offset;
+    const char *reason;
+} cJSON_ParseError;
+
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
  * This is to prevent stack overflows. */
 #ifndef CJSON_NESTING_LIMIT
@@ -148,6 +193,9 @@ CJSON_PUBLIC(const char*) cJSON_Version(void);
 
 /* Supply malloc, realloc and free functions to cJSON */
 CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks);
+/* When built with CJSON_NODE_SLAB, nodes come from blocks allocated with the hooks and freed nodes are cached per thread.
+ * A thread that stops using cJSON can hand its cached nodes over to the other threads with this. No-op otherwise. */
+CJSON_PUBLIC(void) cJSON_ReleaseThreadCache(void);
 
 /* Memory Management: the caller is always responsible to free the results from all variants of cJSON_Parse (with cJSON_Delete) and cJSON_Print (with stdlib free, cJSON_Hooks.free_fn, or cJSON_free as appropriate). The exception is cJSON_PrintPreallocated, where the caller has full responsibility of the buffer. */
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. */
@@ -157,6 +205,31 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Reports where and why parsing failed in *parse_failure instead of the per thread state behind cJSON_GetErrorPtr().
+ * Only whitespace may follow the value ("trailing characters" otherwise), a null character ends the text. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithError(const char *value, size_t buffer_length, cJSON_ParseError *parse_failure);
+
+/* Incremental parsing of a JSON text that arrives in chunks (e.g. from recv()/read()).
+ * cJSON_StreamFeed consumes bytes up to the end of the first complete value and stores how many in *consumed,
+ * so the rest of the chunk can be fed again after the result has been taken.
+ * The tree is built while the chunks arrive, only the string, number or literal being read is buffered.
+ * A top level number or literal is only known to be complete at a delimiter or at cJSON_StreamFinish (end of input).
+ * max_length limits the size of a value in bytes, leading whitespace excluded (0 for no limit). */
+typedef struct cJSON_Stream cJSON_Stream;
+#define cJSON_StreamError (-1)
+#define cJSON_StreamNeedMore 0
+#define cJSON_StreamComplete 1
+CJSON_PUBLIC(cJSON_Stream *) cJSON_StreamCreate(size_t max_length);
+CJSON_PUBLIC(int) cJSON_StreamFeed(cJSON_Stream *stream, const char *chunk, size_t length, size_t *consumed);
+/* Signal end of input. Returns cJSON_StreamNeedMore if nothing but whitespace was fed. */
+CJSON_PUBLIC(int) cJSON_StreamFinish(cJSON_Stream *stream);
+/* Returns the parsed value (to be freed with cJSON_Delete) and makes the stream ready for the next value. */
+CJSON_PUBLIC(cJSON *) cJSON_StreamTakeResult(cJSON_Stream *stream);
+/* Returns true and fills *parse_failure (offset counted from the first byte fed) when the stream is in the error state. */
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamGetError(const cJSON_Stream *stream, cJSON_ParseError *parse_failure);
+/* Drop any partial or parsed value, keeping the allocated buffers. */
+CJSON_PUBLIC(void) cJSON_StreamReset(cJSON_Stream *stream);
+CJSON_PUBLIC(void) cJSON_StreamDelete(cJSON_Stream *stream);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -167,6 +240,11 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 /* Render a cJSON entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
 /* NOTE: cJSON is not always 100% accurate in estimating how much memory it will use, so to be safe allocate 5 bytes more than you actually need */
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
+/* Render a cJSON entity to text in pieces, without holding the whole text in memory. flush is called with the text
+ * rendered so far each time the buffer of buffer_size bytes is full (it only grows for a single string that doesn't fit),
+ * and a last time with last set. Returning false from flush stops printing. Returns 1 on success and 0 on failure. */
+typedef cJSON_bool (*cJSON_PrintFlush)(const char *text, size_t length, cJSON_bool last, void *context);
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, cJSON_bool format, size_t buffer_size, cJSON_PrintFlush flush, void *context);
 /* Delete a cJSON entity and all subentities. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item);
 
@@ -179,6 +257,7 @@ CJSON_PUBLIC(cJSON *) cJSON_GetObjectItem(const cJSON * const object, const char
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *string);
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
+/* The error is kept per thread, so concurrent parses don't overwrite each other's. */
 CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void);
 
 /* Check item type and return its value */
@@ -4,9 +4,45 @@
 //#define _GNU_SOURCE
 #include <stdatomic.h>
 
+// Transport used when none is given on the command line (--stdio, --http).
 // Comment to enable HTTP
 //#define MCP_STDIO
 
+// Uncomment to read stdin from the main loop instead of a reader thread
+//#define MCP_STDIO_POLL
+
+// Uncomment to write stdio responses from a dedicated thread, so a slow
+// client never stalls the main loop
+//#define MCP_STDIO_WRITER_THREAD
+
+// Uncomment to frame stdio messages with Content-Length headers (as in
+// LSP) instead of one JSON message per line
+//#define MCP_STDIO_CONTENT_LENGTH
+
+// Uncomment to run stdio tools/call requests on this many worker threads.
+// Responses are then written as they complete, out of request order.
+//#define MCP_STDIO_WORKERS 4
+
+// Uncomment to also serve HTTP on a Unix domain socket, for local clients.
+//#define MCP_UNIX_SOCKET "/tmp/cmcp.sock"
+
+// Number of HTTP threads. Above 1 each one accepts, reads and parses on
+// its own SO_REUSEPORT listener. Uncomment MCP_HTTP_PIN_CPUS to pin
+// thread i to CPU i.
+#ifndef MCP_HTTP_THREADS
+#define MCP_HTTP_THREADS 1
+#endif
+//#define MCP_HTTP_PIN_CPUS
+
+// Uncomment to run the HTTP threads on io_uring (Linux 6.0+): multishot
+// accept, reads into kernel-selected buffers, responses sent and closed
+// by the thread that read the request. Falls back to blocking I/O when
+// the kernel refuses the ring.
+//#define MCP_HTTP_IO_URING
+
+// Uncomment to give each tools/call a deadline, see mcp_call_expired()
+//#define MCP_TOOL_TIMEOUT_MS 30000
+
 
 extern _Atomic int done;
 
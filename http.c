@@ -2,13 +2,22 @@
 
 #include "config.h"
 #include "http.h"
+#include "http_parser.h"
 #include "mcp.h"
+#include "queue.h"
+#include "session.h"
+#if defined(MCP_HTTP_IO_URING)
+#include "uring.h"
+#include "wheel.h"
+#include <sys/eventfd.h>
+#endif
 
 // cc -O2 -pthread rt_http_control.c -o rt_http_control
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
@@ -18,76 +27,72 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
-/* ===========================
-   Simple MPSC queue for JSON lines
-   =========================== */
-#ifndef QUEUE_CAP
-#define QUEUE_CAP 1024
-#endif
-
+// Largest accepted body. Bodies are parsed as they arrive so nothing is sized from it.
 #ifndef MSG_MAX
-#define MSG_MAX 4096
+#define MSG_MAX (1024*1024)
 #endif
 
-//#define DEBUG_TRACE
+// Time a client has to send the request head, then the body (io_uring engine;
+// the blocking threads rely on SO_RCVTIMEO)
+#ifndef MCP_HTTP_HEADER_TIMEOUT_MS
+#define MCP_HTTP_HEADER_TIMEOUT_MS 5000
+#endif
+#ifndef MCP_HTTP_BODY_TIMEOUT_MS
+#define MCP_HTTP_BODY_TIMEOUT_MS 30000
+#endif
 
+// Admission control: connections open at once, and requests waiting in the
+// queue when a new one is refused before its body is read
+#ifndef MCP_HTTP_MAX_CONNS
+#define MCP_HTTP_MAX_CONNS 1024
+#endif
+#ifndef MCP_HTTP_MAX_QUEUED
+#define MCP_HTTP_MAX_QUEUED (QUEUE_CAP * 3 / 4)
+#endif
+#ifndef MCP_HTTP_RETRY_AFTER_MAX
+#define MCP_HTTP_RETRY_AFTER_MAX 30 // seconds
+#endif
 
-typedef struct {
-    char data[MSG_MAX];
-    int cfd;
-} msg_t;
+// Time a request may wait in the queue when the client gives none with
+// the Mcp-Request-Timeout header (ms) or params._meta.timeoutMs. After it
+// the request is answered 503 instead of being run. 0 for no limit.
+#ifndef MCP_HTTP_QUEUE_TIMEOUT_MS
+#define MCP_HTTP_QUEUE_TIMEOUT_MS 0
+#endif
 
-typedef struct {
-    msg_t ring[QUEUE_CAP];
-    size_t head; // next pop
-    size_t tail; // next push
-    pthread_mutex_t mu;
-} msg_queue_t;
+// Work done by one process_http() call, so the host loop keeps its cycle
+// time under load: at most this many requests, and no new one once this
+// many microseconds were spent (0 for no time limit). The rest waits for
+// the next call.
+#ifndef MCP_HTTP_DISPATCH_MAX
+#define MCP_HTTP_DISPATCH_MAX 32
+#endif
+#ifndef MCP_HTTP_DISPATCH_US
+#define MCP_HTTP_DISPATCH_US 2000
+#endif
 
-static void queue_init(msg_queue_t* q) {
-    memset(q, 0, sizeof(*q));
-    pthread_mutex_init(&q->mu, NULL);
-}
-static bool queue_try_push(msg_queue_t* q, const char* line,int cfd) {
-#if defined(DEBUG_TRACE)
-    printf("Enqueuing %s\n",line);
+// An SSE response event is printed in pieces of this size, each sent as one chunk
+#ifndef HTTP_CHUNK_SIZE
+#define HTTP_CHUNK_SIZE (16*1024)
 #endif
-    pthread_mutex_lock(&q->mu);
-    size_t next_tail = (q->tail + 1) % QUEUE_CAP;
-    if (next_tail == q->head) { // full
-        pthread_mutex_unlock(&q->mu);
-        return false;
-    }
-    q->ring[q->tail].cfd = cfd;
-    snprintf(q->ring[q->tail].data, MSG_MAX, "%s", line);
-    q->tail = next_tail;
-    pthread_mutex_unlock(&q->mu);
-    return true;
-}
-static bool queue_try_pop(msg_queue_t* q, char out[MSG_MAX],int *cfd) {
-    bool ok = false;
-    pthread_mutex_lock(&q->mu);
-    if (q->head != q->tail) {
-        snprintf(out, MSG_MAX, "%s", q->ring[q->head].data);
-        *cfd = q->ring[q->head].cfd;
-        q->head = (q->head + 1) % QUEUE_CAP;
-        ok = true;
-    }
-    pthread_mutex_unlock(&q->mu);
-    return ok;
-}
+
+//#define DEBUG_TRACE
 
 /* Expose non-blocking dequeue to your realtime loop */
-static msg_queue_t g_cmd_queue;
-static inline bool try_dequeue(char out[MSG_MAX],int *cfd) {
-    return queue_try_pop(&g_cmd_queue, out,cfd);
+static lane_queue_t g_cmd_queue;
+static inline bool try_dequeue(msg_t* out) {
+    return lane_queue_pop(&g_cmd_queue, out);
 }
 
+
 /* ===========================
    Minimal HTTP parser (enough for POST /cmd)
    =========================== */
@@ -95,6 +100,10 @@ static inline bool try_dequeue(char out[MSG_MAX],int *cfd) {
 static int set_sockopts(int fd) {
     int yes = 1;
     if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0) return -1;
+#if MCP_HTTP_THREADS > 1
+    // one listener per thread on the same port, the kernel spreads connections
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0) return -1;
+#endif
 
     // modest recv timeout so  doesn't block the thread forever
     struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
@@ -117,19 +126,27 @@ static int create_listen_socket(uint16_t port) {
     return fd;
 }
 
-static ssize_t recv_all(int fd, char* buf, size_t want) {
-    size_t got = 0;
-    while (got < want) {
-        ssize_t n = recv(fd, buf + got, want - got, 0);
-        if (n == 0) return (ssize_t)got; // peer closed
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        got += (size_t)n;
-    }
-    return (ssize_t)got;
+#if defined(MCP_UNIX_SOCKET)
+/* Same protocol for local clients, without the TCP stack */
+static int create_unix_socket(const char* path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) { close(fd); return -1; }
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path); // left by a previous run, anything else makes bind() fail
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+    if (listen(fd, 64) < 0) { close(fd); unlink(path); return -1; }
+    return fd;
 }
+#endif
 
 static void http_400(int cfd, const char* msg) {
 #if defined(DEBUG_TRACE)
@@ -147,12 +164,90 @@ static void http_404(int cfd) {
             strlen(m), m);
 }
 
+#if defined(MCP_HTTP_IO_URING)
+static void http_408(int cfd) {
+#if defined(DEBUG_TRACE)
+    printf("HTTP 408\n");
+#endif
+    const char* m = "request timeout";
+    dprintf(cfd, "HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s",
+            strlen(m), m);
+}
+#endif
+
+/* ===========================
+   Overload: a connection over MCP_HTTP_MAX_CONNS, or a request
+   arriving with MCP_HTTP_MAX_QUEUED already waiting, is answered
+   503 at once. Retry-After is the time the main loop needs for
+   the queue at the rate it dequeued while it was busy.
+   =========================== */
+static _Atomic int g_conns;               // accepted, not closed yet
+static _Atomic unsigned g_dequeue_us;     // main loop time per request, 0 until measured
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Main loop: n requests dequeued by a call that began at start. The rate
+   is only taken over calls that all found work, idle time would make it
+   look slow. */
+static void measure_dequeue(size_t n, int64_t start) {
+    static int64_t window_start;
+    static size_t window_count;
+    if (n == 0) { window_start = 0; return; }
+    int64_t now = now_us();
+    if (window_start == 0) { window_start = start; window_count = 0; }
+    window_count += n;
+    int64_t elapsed = now - window_start;
+    if (elapsed < 1000000) return;
+    unsigned us = (unsigned)((size_t)elapsed / window_count);
+    unsigned old = atomic_load_explicit(&g_dequeue_us, memory_order_relaxed);
+    atomic_store_explicit(&g_dequeue_us, old ? (old * 3 + us) / 4 : us, memory_order_relaxed);
+    window_start = now;
+    window_count = 0;
+}
+
+static unsigned retry_after(size_t depth) {
+    unsigned us = atomic_load_explicit(&g_dequeue_us, memory_order_relaxed);
+    size_t s = depth * us / 1000000 + 1;
+    return s > MCP_HTTP_RETRY_AFTER_MAX ? MCP_HTTP_RETRY_AFTER_MAX : (unsigned)s;
+}
+
+/* The request is not read: what already arrived is discarded so that
+   closing does not reset the connection before the client reads the 503 */
+static void http_503(int cfd, size_t depth) {
+#if defined(DEBUG_TRACE)
+    printf("HTTP 503\n");
+#endif
+    const char* m = "overloaded";
+    dprintf(cfd, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %u\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s",
+            retry_after(depth), strlen(m), m);
+    shutdown(cfd, SHUT_WR);
+    char buf[4096];
+    for (int i = 0; i < 16 && recv(cfd, buf, sizeof(buf), MSG_DONTWAIT) > 0; i++) { }
+}
+
+static void close_client(int cfd) {
+    close(cfd);
+    atomic_fetch_sub_explicit(&g_conns, 1, memory_order_relaxed);
+}
+
+/* Count an accepted connection, false when it was refused and closed */
+static bool admit_client(int cfd) {
+    if (atomic_fetch_add_explicit(&g_conns, 1, memory_order_relaxed) < MCP_HTTP_MAX_CONNS) return true;
+    http_503(cfd, lane_queue_depth(&g_cmd_queue));
+    close_client(cfd);
+    return false;
+}
+
 static void http_405(int cfd) {
 #if defined(DEBUG_TRACE)
     printf("HTTP 405\n");
 #endif
     const char* m = "not allowed";
-    dprintf(cfd, "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s",
+    dprintf(cfd, "HTTP/1.1 405 Method Not Allowed\r\nAllow: POST\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n%s",
             strlen(m), m);
 }
 
@@ -172,183 +267,990 @@ void http_200_json(int cfd, const char* body) {
     dprintf(cfd, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s", len, body);
 }
 
-static void trim_trailing_newlines(char* s) {
-    size_t n = strlen(s);
-    while (n && (s[n-1] == '\n' || s[n-1] == '\r')) s[--n] = 0;
+/* ===========================
+   HTTP threads, each with its own listener and buffers
+   =========================== */
+typedef struct {
+    pthread_t thr;
+    int listen_fd;
+    int unix_fd; // -1 unless this thread serves MCP_UNIX_SOCKET
+    int cpu;     // pinned to this CPU, -1 for none
+    cJSON_Stream *body_stream;
+    http_request_t req; // points into hdr
+    char hdr[8192*2];
+#if defined(MCP_HTTP_IO_URING)
+    bool use_uring; // false when io_uring could not be set up
+    uring_t ring;
+    uring_bufs_t bufs;
+    int wake_fd;    // eventfd, written when the main loop posts a send
+    uint64_t wake_value;
+    pthread_mutex_t send_mu;
+    struct send_job* posted; // sends from the main loop, newest first
+    struct send_job* inflight;
+    struct uconn* conns;     // connections being read
+    struct uconn* free_conns;
+    timer_wheel_t wheel; // read deadlines of conns
+    struct __kernel_timespec tick_ts;
+    bool tick_armed;
+    unsigned missed; // 1u << UD_ACCEPT/UD_ACCEPT_UNIX/UD_WAKE: not armed, the ring was full
+#endif
+} http_worker_t;
+
+typedef struct {
+    http_worker_t workers[MCP_HTTP_THREADS];
+    int started;
+    _Atomic bool running;
+} http_server_t;
+
+#if defined(MCP_HTTP_IO_URING)
+static void uring_post_send(http_worker_t* w, int fd, const char* head, size_t head_len, char* body, size_t body_len);
+#endif
+
+// mcp_conn_t.flags
+#define HTTP_ACCEPTS_SSE 1u // the request had Accept: text/event-stream
+#define HTTP_CHUNKED     2u // the response head was sent, the body goes in chunks
+#define HTTP_SSE         4u // the body is an event stream
+#define HTTP_HAD_SESSION 8u // the request came with Mcp-Session-Id
+#define HTTP_CUT_OFF    16u // an event was cut off, nothing more goes out
+
+// false when the client is gone
+static bool write_iov(int fd, struct iovec* iov, int count) {
+    int i = 0;
+    while (i < count) {
+        struct msghdr msg = { .msg_iov = &iov[i], .msg_iovlen = (size_t)(count - i) };
+        ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL); // no SIGPIPE when the client left mid-response
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        size_t left = (size_t)w;
+        while (i < count && left >= iov[i].iov_len) left -= iov[i++].iov_len;
+        if (i < count) { iov[i].iov_base = (char*)iov[i].iov_base + left; iov[i].iov_len -= left; }
+    }
+    return true;
+}
+
+/* Head of a 200 response, content_length is ignored when chunked. A session
+   created by the request (initialize) is announced with Mcp-Session-Id. */
+static int response_head(const mcp_conn_t *conn, char* buf, size_t size, bool sse, bool chunked, size_t content_length) {
+    char session[64] = "";
+    if (conn->session && !(conn->flags & HTTP_HAD_SESSION))
+        snprintf(session, sizeof(session), "Mcp-Session-Id: %s\r\n", conn->session->id);
+    char length[48];
+    if (chunked) snprintf(length, sizeof(length), "Transfer-Encoding: chunked\r\n");
+    else snprintf(length, sizeof(length), "Content-Length: %zu\r\n", content_length);
+    return snprintf(buf, size, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Type: %s\r\n%s%s%s\r\n",
+                    sse ? "text/event-stream" : "application/json", sse ? "Cache-Control: no-cache\r\n" : "",
+                    session, length);
 }
 
-char hdr[8192*2];
+/* One chunk of the body: prefix, text and suffix. The response head goes
+   with the first one. */
+static bool write_chunk(mcp_conn_t *conn, const char* prefix, const char* text, size_t len, const char* suffix) {
+    size_t prefix_len = strlen(prefix), suffix_len = strlen(suffix);
+    char size[24];
+    int n = snprintf(size, sizeof(size), "%zx\r\n", prefix_len + len + suffix_len);
+    struct iovec iov[6];
+    int count = 0;
+    char head[256];
+    if (!(conn->flags & HTTP_CHUNKED)) {
+        int h = response_head(conn, head, sizeof(head), conn->flags & HTTP_SSE, true, 0);
+        iov[count++] = (struct iovec){ head, (size_t)h };
+        conn->flags |= HTTP_CHUNKED;
+    }
+    iov[count++] = (struct iovec){ size, (size_t)n };
+    iov[count++] = (struct iovec){ (void*)prefix, prefix_len };
+    iov[count++] = (struct iovec){ (void*)text, len };
+    iov[count++] = (struct iovec){ (void*)suffix, suffix_len };
+    iov[count++] = (struct iovec){ "\r\n", 2 };
+    return write_iov(conn->fd, iov, count);
+}
 
-/* Handle exactly: POST /cmd HTTP/1.1, with single-line JSON body */
-static void handle_http_client(int cfd) {
-    // Read until we have headers (\r\n\r\n)
-    size_t used = 0;
-    for (;;) {
-        if (used >= sizeof(hdr)) { http_400(cfd, "headers too large"); return; }
-        ssize_t n = recv(cfd, hdr + used, sizeof(hdr) - used, 0);
-        if (n <= 0) { return; }
-        used += (size_t)n;
-        // search for end of headers
-        char* p = NULL;
-        for (size_t i = 3; i < used; ++i) {
-            if (hdr[i-3]=='\r' && hdr[i-2]=='\n' && hdr[i-1]=='\r' && hdr[i]=='\n') {
-                p = &hdr[i+1]; // first byte after CRLFCRLF
-                break;
-            }
-        }
-        if (!p) continue;
+/* One SSE event in its own chunk. Chunks are written right away from the
+   dispatch thread, also for connections read by io_uring: nothing is in
+   flight on them until the response is posted. */
+static void sse_event(mcp_conn_t *conn, char *json, size_t len) {
+    if (conn->flags & HTTP_CUT_OFF) { cJSON_free(json); return; }
+#if defined(DEBUG_TRACE)
+    printf("HTTP SSE: %.*s\n\n", (int)len, json);
+#endif
+    conn->flags |= HTTP_SSE;
+    write_chunk(conn, "data: ", json, len, "\n\n");
+    cJSON_free(json);
+}
+
+/* Response to a request from the queue: header and the printed body
+   go out in one writev(), the body is not copied */
+static void http_write(mcp_conn_t *conn, char *json, size_t len) {
+    if (conn->flags & HTTP_SSE) { sse_event(conn, json, len); return; }
+#if defined(DEBUG_TRACE)
+    printf("HTTP 200: %.*s\n\n", (int)len, json);
+#endif
+    char head[256];
+    int n = response_head(conn, head, sizeof(head), false, false, len);
+#if defined(MCP_HTTP_IO_URING)
+    if (conn->ctx) { // read by an io_uring thread, which sends and closes
+        uring_post_send(conn->ctx, conn->fd, head, (size_t)n, json, len);
+        return;
+    }
+#endif
+    struct iovec iov[2] = { { head, (size_t)n }, { json, len } };
+    write_iov(conn->fd, iov, 2);
+    cJSON_free(json);
+}
+
+/* A notification before the response switches the response to an event
+   stream, when the client accepts one. Plain JSON responses are kept
+   for requests that don't send any. */
+static bool http_notify(mcp_conn_t *conn, char *json, size_t len) {
+    if (!(conn->flags & HTTP_ACCEPTS_SSE)) {
+        cJSON_free(json);
+        return false;
+    }
+    sse_event(conn, json, len);
+    return true;
+}
+
+typedef struct {
+    mcp_conn_t *conn;
+    bool started;
+} http_stream_t;
+
+// One SSE event may span several chunks
+static cJSON_bool http_flush(const char *text, size_t len, cJSON_bool last, void *context) {
+    http_stream_t *s = context;
+    const char* prefix = s->started ? "" : "data: ";
+    const char* suffix = last ? "\n\n" : "";
+    s->started = true;
+    return write_chunk(s->conn, prefix, text, len, suffix);
+}
 
-        // Parse request line (must start at hdr)
-        char method[8], path[64], version[16];
-        if (sscanf(hdr, "%7s %63s %15s", method, path, version) != 3) {
-            http_400(cfd, "bad request line"); return;
+/* A plain response is printed once and handed to http_write(). The last
+   event of an SSE stream goes out in chunks while it is printed, the
+   whole text is never in memory. An event cut off by a failure is not
+   finished, the connection is closed without the last chunk. */
+static bool http_stream(mcp_conn_t *conn, const cJSON *response) {
+    if (!(conn->flags & HTTP_SSE)) {
+        char *json = cJSON_PrintUnformatted(response);
+        if (!json) return false;
+        http_write(conn, json, strlen(json));
+        return true;
+    }
+    http_stream_t s = { .conn = conn, .started = false };
+    if (cJSON_PrintStreamed(response, false, HTTP_CHUNK_SIZE, http_flush, &s)) return true;
+    if (s.started) conn->flags |= HTTP_CUT_OFF;
+    return false;
+}
+
+/* Notifications are acknowledged with 202, the connection is closed */
+static void http_complete(mcp_conn_t *conn) {
+    if (conn->flags & HTTP_CHUNKED) {
+        struct iovec last = { "0\r\n\r\n", 5 };
+        if (!(conn->flags & HTTP_CUT_OFF)) write_iov(conn->fd, &last, 1);
+        close_client(conn->fd);
+        return;
+    }
+#if defined(MCP_HTTP_IO_URING)
+    if (conn->ctx) { // already closed after the response
+        if (!conn->responded) {
+            static const char accepted[] = "HTTP/1.1 202 Accepted\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: 8\r\n\r\nAccepted";
+            uring_post_send(conn->ctx, conn->fd, accepted, sizeof(accepted) - 1, NULL, 0);
         }
+        return;
+    }
+#endif
+    if (!conn->responded) http_202(conn->fd);
+    close_client(conn->fd);
+}
 
+static bool token_is(const char* s, size_t len, const char* lit) {
+    return len == strlen(lit) && memcmp(s, lit, len) == 0;
+}
+
+/* DELETE /mcp ends the session named by Mcp-Session-Id */
+static void delete_session(int cfd, const http_request_t* req) {
+    const http_header_t* id = http_find_header(req, "Mcp-Session-Id");
+    if (!id) { http_400(cfd, "missing Mcp-Session-Id"); return; }
+    if (!session_remove(id->value, id->value_len)) { http_404(cfd); return; }
+    dprintf(cfd, "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+}
+
+/* Check the parsed request head. Anything but POST /mcp is answered
+   here and false returned, else the body length is returned and msg
+   gets the connection state (flags, session with a reference). */
+static bool request_head(int cfd, const http_request_t* req, msg_t* msg, size_t* content_length) {
 #if defined(DEBUG_TRACE)
-        printf("HTTP %s %s\n", method, path);
-#endif
-        if (strcmp(method, "GET") == 0)
-        {
-           if (strcmp(path, "/health") == 0)
-           {
-               http_200_json(cfd, "{\"status\":\"ok\"}\n");
-               return;
-           }
-
-           else if (strcmp(path, "/mcp") == 0)
-           {
-               http_400(cfd, "GET not supported on /mcp, use POST\n");
-               return;
-           }
-           else 
-           {
-               http_404(cfd); return;
-           }
+    printf("HTTP %.*s %.*s\n", (int)req->method_len, req->method, (int)req->path_len, req->path);
+#endif
+    if (token_is(req->method, req->method_len, "GET"))
+    {
+       if (token_is(req->path, req->path_len, "/health"))
+       {
+           http_200_json(cfd, "{\"status\":\"ok\"}\n");
+       }
+       else if (token_is(req->path, req->path_len, "/mcp"))
+       {
+           http_405(cfd); // no server initiated messages to stream
+       }
+       else 
+       {
+           http_404(cfd);
+       }
+       return false;
+    }
+
+    if (token_is(req->method, req->method_len, "DELETE") && token_is(req->path, req->path_len, "/mcp")) {
+        delete_session(cfd, req); return false;
+    }
+
+    // Only POST /mcp
+    if (!token_is(req->method, req->method_len, "POST") || !token_is(req->path, req->path_len, "/mcp")) {
+        http_404(cfd); return false;
+    }
+
+    const http_header_t* cl = http_find_header(req, "Content-Length");
+    if (!cl) { http_400(cfd, "missing content-length"); return false; }
+    if (!http_header_size(cl, content_length)) { http_400(cfd, "bad content-length"); return false; }
+    if (*content_length > MSG_MAX) { http_400(cfd, "body too large"); return false; }
+    size_t depth = lane_queue_depth(&g_cmd_queue);
+    if (depth >= MCP_HTTP_MAX_QUEUED) { http_503(cfd, depth); return false; } // before reading the body
+
+    msg->flags = 0;
+    msg->enqueued_us = now_us(); // the body is part of the wait
+    msg->deadline_us = 0;
+    size_t timeout_ms = MCP_HTTP_QUEUE_TIMEOUT_MS;
+    const http_header_t* timeout = http_find_header(req, "Mcp-Request-Timeout");
+    if (timeout && !http_header_size(timeout, &timeout_ms)) { http_400(cfd, "bad Mcp-Request-Timeout"); return false; }
+    if (timeout_ms > 0 && timeout_ms < INT32_MAX)
+        msg->deadline_us = msg->enqueued_us + (int64_t)timeout_ms * 1000;
+
+    const http_header_t* accept = http_find_header(req, "Accept");
+    if (accept && memmem(accept->value, accept->value_len, "text/event-stream", 17))
+        msg->flags |= HTTP_ACCEPTS_SSE;
+
+    // Without the header the request is served without a session
+    const http_header_t* id = http_find_header(req, "Mcp-Session-Id");
+    msg->session = NULL;
+    if (id) {
+        msg->session = session_find(id->value, id->value_len);
+        if (!msg->session) { http_404(cfd); return false; } // expired, the client initializes again
+        msg->flags |= HTTP_HAD_SESSION;
+    }
+    return true;
+}
+
+/* params._meta.timeoutMs, when earlier than the deadline of the header */
+static void meta_deadline(msg_t* msg) {
+    const cJSON* params = cJSON_GetObjectItemCaseSensitive(msg->root, "params");
+    const cJSON* meta = cJSON_GetObjectItemCaseSensitive(params, "_meta");
+    const cJSON* timeout = cJSON_GetObjectItemCaseSensitive(meta, "timeoutMs");
+    if (!cJSON_IsNumber(timeout) || !(timeout->valuedouble > 0) || timeout->valuedouble >= INT32_MAX) return;
+    int64_t deadline = msg->enqueued_us + (int64_t)(timeout->valuedouble * 1000);
+    if (msg->deadline_us == 0 || deadline < msg->deadline_us) msg->deadline_us = deadline;
+}
+
+/* Queue the request whose body went through the parser, msg has the
+   connection from request_head(). Returns true when queued, the main loop
+   then owns cfd and the session reference. */
+static bool queue_request(cJSON_Stream* stream, int status, msg_t* msg) {
+    if (status == cJSON_StreamNeedMore)
+        status = cJSON_StreamFinish(stream); // top level scalar or empty body
+
+    msg->root = NULL;
+    msg->parse_error = false;
+    if (status == cJSON_StreamComplete) {
+        msg->root = cJSON_StreamTakeResult(stream);
+        meta_deadline(msg);
+    }
+    else
+    {
+        msg->parse_error = cJSON_StreamGetError(stream, &msg->error);
+        cJSON_StreamReset(stream);
+    }
+
+    // Enqueue (non-blocking); filled up while the body was read
+    if (!lane_queue_push(&g_cmd_queue, msg)) {
+        cJSON_Delete(msg->root);
+        session_release(msg->session);
+        http_503(msg->cfd, QUEUE_CAP - 1);
+        return false;
+    }
+    return true;
+}
+
+/* Handle exactly: POST /cmd HTTP/1.1, with single-line JSON body.
+   Returns true when the request was queued, the main loop then owns cfd. */
+static bool handle_http_client(http_worker_t* w, int cfd) {
+    // Read until we have the whole head, each recv() only scans the new bytes
+    size_t used = 0;
+    int head_len = HTTP_PARSE_INCOMPLETE;
+    http_request_init(&w->req);
+    while (head_len == HTTP_PARSE_INCOMPLETE) {
+        if (used >= sizeof(w->hdr)) { http_400(cfd, "headers too large"); return false; }
+        ssize_t n = recv(cfd, w->hdr + used, sizeof(w->hdr) - used, 0);
+        if (n <= 0) { return false; }
+        used += (size_t)n;
+        head_len = http_parse_request(&w->req, w->hdr, used);
+    }
+    if (head_len == HTTP_PARSE_ERROR) { http_400(cfd, "bad request head"); return false; }
+    char* p = w->hdr + head_len;
+
+    size_t content_length = 0;
+    msg_t msg = { .cfd = cfd, .ctx = NULL };
+    if (!request_head(cfd, &w->req, &msg, &content_length)) return false;
+
+    // Feed already-buffered body bytes to the parser
+    size_t header_bytes = (size_t)(p - w->hdr);
+    size_t have_in_buf = (used > header_bytes) ? (used - header_bytes) : 0;
+    size_t copy = have_in_buf > content_length ? content_length : have_in_buf;
+    // If there are extra pipelined bytes we ignore them; we close anyway.
+    int status = cJSON_StreamFeed(w->body_stream, p, copy, NULL);
+
+    // Parse the rest as it is received. The whole body is still read
+    // so that closing the socket doesn't reset the connection.
+    size_t remaining = content_length - copy;
+    while (remaining > 0) {
+        ssize_t n = recv(cfd, w->hdr, remaining < sizeof(w->hdr) ? remaining : sizeof(w->hdr), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { cJSON_StreamReset(w->body_stream); session_release(msg.session); return false; }
+        if (status == cJSON_StreamNeedMore)
+            status = cJSON_StreamFeed(w->body_stream, w->hdr, (size_t)n, NULL);
+        remaining -= (size_t)n;
+    }
+    return queue_request(w->body_stream, status, &msg);
+}
+
+/* Wait for a connection on any listener of the thread */
+static int accept_any(http_worker_t* w) {
+    struct pollfd pfd[2] = {
+        { .fd = w->listen_fd, .events = POLLIN, .revents = 0 },
+        { .fd = w->unix_fd,   .events = POLLIN, .revents = 0 }, // ignored when -1
+    };
+    int n = poll(pfd, 2, 100); // wakes up to check running
+    if (n <= 0) {
+        if (n == 0) errno = EAGAIN;
+        return -1;
+    }
+    int fd = (pfd[0].revents & POLLIN) ? w->listen_fd : w->unix_fd;
+    if (fd < 0) { errno = EAGAIN; return -1; }
+    return accept(fd, NULL, NULL);
+}
+
+static http_server_t srv;
+
+#if defined(MCP_HTTP_IO_URING)
+/* ===========================
+   io_uring engine: accepts are multishot, reads use buffers
+   provided to the kernel, and a response is a send linked to
+   the close of the connection. The thread only sleeps in
+   io_uring_enter(), the main loop wakes it with an eventfd.
+   =========================== */
+#ifndef URING_ENTRIES
+#define URING_ENTRIES 256
+#endif
+#ifndef URING_BUF_COUNT
+#define URING_BUF_COUNT 64 // power of two
+#endif
+#ifndef URING_BUF_SIZE
+#define URING_BUF_SIZE (16*1024)
+#endif
+#define URING_BUF_GROUP 0
+#ifndef URING_TICK_MS
+#define URING_TICK_MS 50 // resolution of the read deadlines
+#endif
+
+// Operation in the low bits of user_data, the rest is a pointer
+enum { UD_ACCEPT = 1, UD_ACCEPT_UNIX, UD_WAKE, UD_RECV, UD_SEND, UD_CLOSE, UD_TICK };
+#define UD_OP_MASK 7u
+#define UD(ptr, op) ((uint64_t)(uintptr_t)(ptr) | (op))
+#define UD_PTR(ud) ((void*)(uintptr_t)((ud) & ~(uint64_t)UD_OP_MASK))
+
+/* A connection until its request is queued */
+typedef struct uconn {
+    struct uconn* prev;
+    struct uconn* next;
+    int fd;
+    bool in_body;
+    size_t used;      // head bytes in hdr
+    http_request_t req;
+    size_t remaining; // body bytes still to read
+    int status;       // of the body parser
+    msg_t msg;        // for the queue once the body is read
+    wheel_timer_t deadline; // of the head, then of the body
+    cJSON_Stream* stream;
+    char hdr[8192*2];
+} uconn_t;
+
+typedef struct send_job {
+    struct send_job* prev;
+    struct send_job* next;
+    int fd;
+    char* body; // printed by cJSON, NULL when head is the whole response
+    struct msghdr msg;
+    struct iovec iov[2];
+    char head[256];
+} send_job_t;
+
+#define LIST_PUSH(head, item) do {            \
+        (item)->prev = NULL;                      \
+        (item)->next = (head);                    \
+        if (head) (head)->prev = (item);          \
+        (head) = (item);                          \
+    } while (0)
+#define LIST_REMOVE(head, item) do {                          \
+        if ((item)->prev) (item)->prev->next = (item)->next;  \
+        else (head) = (item)->next;                           \
+        if ((item)->next) (item)->next->prev = (item)->prev;  \
+    } while (0)
+
+static void uring_wake(http_worker_t* w) {
+    uint64_t one = 1;
+    if (write(w->wake_fd, &one, sizeof(one)) < 0) { /* counter saturated, still readable */ }
+}
+
+/* Main loop side: hand a response over to the thread that read the request */
+static void uring_post_send(http_worker_t* w, int fd, const char* head, size_t head_len, char* body, size_t body_len) {
+    send_job_t* job = malloc(sizeof(*job));
+    if (!job || head_len > sizeof(job->head)) {
+        free(job);
+        cJSON_free(body);
+        close_client(fd);
+        return;
+    }
+    job->fd = fd;
+    job->body = body;
+    memcpy(job->head, head, head_len);
+    job->iov[0] = (struct iovec){ job->head, head_len };
+    job->iov[1] = (struct iovec){ body, body_len };
+    memset(&job->msg, 0, sizeof(job->msg));
+    job->msg.msg_iov = job->iov;
+    job->msg.msg_iovlen = body ? 2 : 1;
+
+    pthread_mutex_lock(&w->send_mu);
+    bool wake = (w->posted == NULL); // else a wake-up is already pending
+    LIST_PUSH(w->posted, job);
+    pthread_mutex_unlock(&w->send_mu);
+    if (wake) uring_wake(w);
+}
+
+/* uring_get_sqe() already submitted what was queued to make room. When
+   the kernel still takes nothing, the accept or wake-up read is armed
+   again after the next batch of completions, see arm_missed(). */
+static void arm_accept(http_worker_t* w, int fd, int op) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&w->ring);
+    if (!sqe) { w->missed |= 1u << op; return; }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = UD(NULL, op);
+}
+
+static void arm_wake(http_worker_t* w) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&w->ring);
+    if (!sqe) { w->missed |= 1u << UD_WAKE; return; }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = w->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&w->wake_value;
+    sqe->len = sizeof(w->wake_value);
+    sqe->user_data = UD(NULL, UD_WAKE);
+}
+
+static void conn_release(http_worker_t* w, uconn_t* c, bool close_fd);
+
+/* A connection that can't be read any more is answered like a full
+   queue and closed, rather than left without a pending recv */
+static void arm_recv(http_worker_t* w, uconn_t* c) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&w->ring);
+    if (!sqe) {
+        http_503(c->fd, lane_queue_depth(&g_cmd_queue));
+        conn_release(w, c, true);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = UD(c, UD_RECV);
+}
+
+static uint64_t tick_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000) / URING_TICK_MS;
+}
+
+static uint64_t ticks_from_now(timer_wheel_t* wheel, unsigned ms) {
+    return wheel->now + (ms + URING_TICK_MS - 1) / URING_TICK_MS;
+}
+
+// tick_armed stays false without an SQE, tried again after the next batch
+static void arm_tick(http_worker_t* w) {
+    struct io_uring_sqe* sqe = uring_get_sqe(&w->ring);
+    if (!sqe) return;
+    w->tick_ts.tv_sec = 0;
+    w->tick_ts.tv_nsec = URING_TICK_MS * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&w->tick_ts;
+    sqe->len = 1;
+    sqe->user_data = UD(NULL, UD_TICK);
+    w->tick_armed = true;
+}
+
+/* The client is too slow: the pending recv sees the shutdown and
+   completes with 0, which releases the connection */
+static void conn_timeout(wheel_timer_t* t, void* arg) {
+    (void)t;
+    uconn_t* c = arg;
+    http_408(c->fd);
+    shutdown(c->fd, SHUT_RDWR);
+}
+
+static void conn_release(http_worker_t* w, uconn_t* c, bool close_fd) {
+    wheel_cancel(&w->wheel, &c->deadline);
+    if (close_fd) close_client(c->fd);
+    session_release(c->msg.session);
+    c->msg.session = NULL;
+    cJSON_StreamReset(c->stream);
+    LIST_REMOVE(w->conns, c);
+    LIST_PUSH(w->free_conns, c); // kept with its parser for the next connection
+}
+
+static void conn_open(http_worker_t* w, int fd) {
+    uconn_t* c = w->free_conns;
+    if (c) {
+        LIST_REMOVE(w->free_conns, c);
+    } else {
+        c = malloc(sizeof(*c));
+        if (c) c->stream = cJSON_StreamCreate(MSG_MAX);
+        if (!c || !c->stream) { free(c); close_client(fd); return; }
+        wheel_timer_init(&c->deadline, conn_timeout, c);
+    }
+    c->fd = fd;
+    c->in_body = false;
+    c->used = 0;
+    http_request_init(&c->req);
+    c->remaining = 0;
+    c->status = cJSON_StreamNeedMore;
+    c->msg.session = NULL;
+    LIST_PUSH(w->conns, c);
+    wheel_add(&w->wheel, &c->deadline, ticks_from_now(&w->wheel, MCP_HTTP_HEADER_TIMEOUT_MS));
+    arm_recv(w, c);
+}
+
+/* Same steps as handle_http_client(), driven by completions.
+   Returns true when more input is needed. */
+static bool conn_input(http_worker_t* w, uconn_t* c, const char* data, size_t n) {
+    if (!c->in_body) {
+        size_t room = sizeof(c->hdr) - c->used;
+        size_t take = n < room ? n : room;
+        memcpy(c->hdr + c->used, data, take);
+        c->used += take;
+        int head_len = http_parse_request(&c->req, c->hdr, c->used);
+        if (head_len == HTTP_PARSE_INCOMPLETE && c->used < sizeof(c->hdr)) return true;
+        if (head_len < 0) {
+            http_400(c->fd, head_len == HTTP_PARSE_ERROR ? "bad request head" : "headers too large");
+            conn_release(w, c, true);
+            return false;
+        }
+        char* p = c->hdr + head_len;
+        size_t content_length = 0;
+        c->msg = (msg_t){ .cfd = c->fd, .ctx = w };
+        if (!request_head(c->fd, &c->req, &c->msg, &content_length)) {
+            conn_release(w, c, true);
+            return false;
         }
+        c->in_body = true;
+        c->remaining = content_length;
+        wheel_add(&w->wheel, &c->deadline, ticks_from_now(&w->wheel, MCP_HTTP_BODY_TIMEOUT_MS));
 
-        // Only POST /cmd
-        if (strcmp(method, "POST") != 0 || strcmp(path, "/mcp") != 0) {
-            http_404(cfd); return;
+        // Body bytes already copied with the head, then the rest of data
+        size_t have = c->used - (size_t)(p - c->hdr);
+        size_t copy = have < c->remaining ? have : c->remaining;
+        c->status = cJSON_StreamFeed(c->stream, p, copy, NULL);
+        c->remaining -= copy;
+        data += take;
+        n -= take;
+    }
+
+    size_t k = n < c->remaining ? n : c->remaining;
+    if (k > 0 && c->status == cJSON_StreamNeedMore)
+        c->status = cJSON_StreamFeed(c->stream, data, k, NULL); // straight from the kernel buffer
+    c->remaining -= k;
+    if (c->remaining > 0) return true;
+
+    bool queued = queue_request(c->stream, c->status, &c->msg);
+    c->msg.session = NULL; // queued, or released by queue_request()
+    conn_release(w, c, !queued);
+    return false;
+}
+
+static void submit_sends(http_worker_t* w) {
+    pthread_mutex_lock(&w->send_mu);
+    send_job_t* jobs = w->posted;
+    w->posted = NULL;
+    pthread_mutex_unlock(&w->send_mu);
+
+    while (jobs) {
+        send_job_t* job = jobs;
+        jobs = job->next;
+        // The send and the close must go in the same submission to stay linked
+        if (uring_sq_space(&w->ring) < 2) uring_submit_and_wait(&w->ring, 0);
+        struct io_uring_sqe* send = uring_get_sqe(&w->ring);
+        struct io_uring_sqe* cls = send ? uring_get_sqe(&w->ring) : NULL;
+        if (!cls) { // ring unusable, finish it here
+            if (sendmsg(job->fd, &job->msg, MSG_NOSIGNAL) < 0) { /* client gone */ }
+            close_client(job->fd);
+            cJSON_free(job->body);
+            free(job);
+            continue;
         }
+        LIST_PUSH(w->inflight, job);
+        send->opcode = IORING_OP_SENDMSG;
+        send->fd = job->fd;
+        send->addr = (uint64_t)(uintptr_t)&job->msg;
+        send->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        send->flags = IOSQE_IO_LINK;
+        send->user_data = UD(job, UD_SEND);
+        cls->opcode = IORING_OP_CLOSE;
+        cls->fd = job->fd;
+        cls->user_data = UD(job, UD_CLOSE);
+    }
+}
 
-        // Find Content-Length
-        size_t content_length = 0;
-        {
-            // crude header parse (case-insensitive not required if you control client)
-            char* cl = strcasestr(hdr, "Content-Length:");
-            if (!cl) { http_400(cfd, "missing content-length"); return; }
-            if (sscanf(cl, "Content-Length: %zu", &content_length) != 1) 
-            {
-                if (sscanf(cl, "content-length: %zu", &content_length) != 1)
-                {
-                   http_400(cfd, "bad content-length"); return;
-                }
-            }
-            if (content_length >= MSG_MAX) { http_400(cfd, "body too large"); return; }
+static void handle_cqe(http_worker_t* w, struct io_uring_cqe* cqe) {
+    void* ptr = UD_PTR(cqe->user_data);
+    switch (cqe->user_data & UD_OP_MASK) {
+    case UD_ACCEPT:
+    case UD_ACCEPT_UNIX:
+        if (cqe->res >= 0 && admit_client(cqe->res)) conn_open(w, cqe->res);
+        if (!(cqe->flags & IORING_CQE_F_MORE) && atomic_load(&srv.running)) {
+            bool tcp = (cqe->user_data & UD_OP_MASK) == UD_ACCEPT;
+            arm_accept(w, tcp ? w->listen_fd : w->unix_fd, (int)(cqe->user_data & UD_OP_MASK));
         }
+        break;
+    case UD_WAKE:
+        if (atomic_load(&srv.running)) arm_wake(w);
+        submit_sends(w);
+        break;
+    case UD_RECV: {
+        uconn_t* c = ptr;
+        if (cqe->res == -ENOBUFS) { arm_recv(w, c); break; } // all buffers in use
+        if (cqe->res <= 0) { conn_release(w, c, true); break; }
+        unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (conn_input(w, c, uring_buf(&w->bufs, id), (size_t)cqe->res)) arm_recv(w, c);
+        uring_bufs_recycle(&w->bufs, id);
+        break;
+    }
+    case UD_SEND:
+        break; // a failed or short send cancels the linked close
+    case UD_CLOSE: {
+        send_job_t* job = ptr;
+        if (cqe->res == -ECANCELED) close(job->fd);
+        atomic_fetch_sub_explicit(&g_conns, 1, memory_order_relaxed);
+        LIST_REMOVE(w->inflight, job);
+        cJSON_free(job->body);
+        free(job);
+        break;
+    }
+    case UD_TICK:
+        w->tick_armed = false; // the wheel is advanced after each batch
+        break;
+    }
+}
+
+static void arm_missed(http_worker_t* w) {
+    unsigned missed = w->missed;
+    w->missed = 0;
+    if (missed & (1u << UD_WAKE)) arm_wake(w);
+    if (missed & (1u << UD_ACCEPT)) arm_accept(w, w->listen_fd, UD_ACCEPT);
+    if (missed & (1u << UD_ACCEPT_UNIX)) arm_accept(w, w->unix_fd, UD_ACCEPT_UNIX);
+}
 
-        // Compute already-buffered body bytes
-        size_t header_bytes = (size_t)(p - hdr);
-        size_t have_in_buf = (used > header_bytes) ? (used - header_bytes) : 0;
-
-        char body[MSG_MAX];
-        if (have_in_buf > 0) {
-            size_t copy = have_in_buf > content_length ? content_length : have_in_buf;
-            memcpy(body, p, copy);
-            // If there are extra pipelined bytes we ignore them; we close anyway.
-            // Read remaining if needed:
-            if (copy < content_length) {
-                ssize_t m = recv_all(cfd, body + copy, content_length - copy);
-                if (m < 0 || (size_t)m != content_length - copy) { return; }
-            }
-        } else {
-            ssize_t m = recv_all(cfd, body, content_length);
-            if (m < 0 || (size_t)m != content_length) { return; }
+static void uring_serve(http_worker_t* w) {
+    w->missed = 0;
+    arm_wake(w);
+    arm_accept(w, w->listen_fd, UD_ACCEPT);
+    if (w->unix_fd >= 0) arm_accept(w, w->unix_fd, UD_ACCEPT_UNIX);
+    wheel_init(&w->wheel, tick_now());
+    w->tick_armed = false;
+    while (atomic_load(&srv.running)) {
+        // Don't sleep on completions while something is waiting to be armed
+        bool retry = w->missed || (w->wheel.pending > 0 && !w->tick_armed);
+        int err = uring_submit_and_wait(&w->ring, retry ? 0 : 1);
+        if (err < 0 && err != -EBUSY) {
+            struct timespec ts = {.tv_sec=0, .tv_nsec=50*1000*1000};
+            nanosleep(&ts, NULL);
+        }
+        struct io_uring_cqe* cqe;
+        while ((cqe = uring_peek_cqe(&w->ring)) != NULL) {
+            struct io_uring_cqe copy = *cqe;
+            uring_cqe_seen(&w->ring);
+            handle_cqe(w, &copy);
         }
+        // One timeout in flight while there are deadlines, none when idle
+        if (w->missed) arm_missed(w);
+        wheel_advance(&w->wheel, tick_now());
+        if (w->wheel.pending > 0 && !w->tick_armed) arm_tick(w);
+    }
+}
 
-        body[content_length] = 0;
-        trim_trailing_newlines(body);           // your convention: one-line JSON
-        // Enqueue (non-blocking); if full, drop with 503-ish JSON
-        if (!queue_try_push(&g_cmd_queue, body,cfd)) {
-            http_400(cfd, "Command queue full\n");
-        } 
-        return;
+static bool uring_open(http_worker_t* w) {
+    w->use_uring = false;
+    w->posted = w->inflight = NULL;
+    w->conns = w->free_conns = NULL;
+    w->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (w->wake_fd < 0) return false;
+    pthread_mutex_init(&w->send_mu, NULL);
+    int err = uring_init(&w->ring, URING_ENTRIES);
+    if (err == 0) {
+        err = uring_bufs_init(&w->ring, &w->bufs, URING_BUF_GROUP, URING_BUF_COUNT, URING_BUF_SIZE);
+        if (err != 0) uring_exit(&w->ring);
+    }
+    if (err != 0) {
+        fprintf(stderr, "io_uring not available (%s), using blocking I/O\n", strerror(-err));
+        return true;
     }
+    w->use_uring = true;
+    return true;
 }
 
-/* ===========================
-   HTTP server thread
-   =========================== */
-typedef struct {
-    int listen_fd;
-    int send_fd;
-    _Atomic bool running;
-} http_server_t;
+static void uring_close(http_worker_t* w) {
+    if (w->use_uring) {
+        // Closing the ring cancels what is in flight
+        uring_bufs_free(&w->ring, &w->bufs);
+        uring_exit(&w->ring);
+        w->use_uring = false;
+    }
+    send_job_t* lists[2] = { w->posted, w->inflight };
+    for (int i = 0; i < 2; i++) {
+        while (lists[i]) {
+            send_job_t* job = lists[i];
+            lists[i] = job->next;
+            close_client(job->fd);
+            cJSON_free(job->body);
+            free(job);
+        }
+    }
+    w->posted = w->inflight = NULL;
+    while (w->conns) conn_release(w, w->conns, true);
+    while (w->free_conns) {
+        uconn_t* c = w->free_conns;
+        w->free_conns = c->next;
+        cJSON_StreamDelete(c->stream);
+        free(c);
+    }
+    if (w->wake_fd >= 0) close(w->wake_fd);
+    w->wake_fd = -1;
+    pthread_mutex_destroy(&w->send_mu);
+}
+#endif
 
 static void* http_thread_main(void* arg) {
-    http_server_t* srv = (http_server_t*)arg;
-    while (atomic_load(&srv->running)) {
-        struct sockaddr_in cli;
-        socklen_t slen = sizeof(cli);
-        int cfd = accept(srv->listen_fd, (struct sockaddr*)&cli, &slen);
+    http_worker_t* w = (http_worker_t*)arg;
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // best effort
+    }
+#if defined(MCP_HTTP_IO_URING)
+    if (w->use_uring) {
+        uring_serve(w);
+        cJSON_ReleaseThreadCache();
+        return NULL;
+    }
+#endif
+    while (atomic_load(&srv.running)) {
+        int cfd = accept_any(w);
         if (cfd < 0) {
+            if (errno == EAGAIN) continue;
             if (errno == EINTR) continue;
             // brief nap to avoid hot loop on transient errors
             struct timespec ts = {.tv_sec=0, .tv_nsec=50*1000*1000};
             nanosleep(&ts, NULL);
             continue;
         }
-        handle_http_client(cfd);
+        if (!admit_client(cfd)) continue;
+        if (!handle_http_client(w, cfd))
+            close_client(cfd); // answered (or dropped) by the HTTP thread
     }
+    cJSON_ReleaseThreadCache();
     return NULL;
 }
 
-static bool http_server_start(http_server_t* srv, uint16_t port, pthread_t* out_thr) {
-    srv->listen_fd = create_listen_socket(port);
-    if (srv->listen_fd < 0) return false;
-    atomic_store(&srv->running, true);
-    if (pthread_create(out_thr, NULL, http_thread_main, srv) != 0) {
-        close(srv->listen_fd);
-        return false;
+static void close_worker(http_worker_t* w) {
+    if (w->listen_fd >= 0) close(w->listen_fd);
+#if defined(MCP_UNIX_SOCKET)
+    if (w->unix_fd >= 0) {
+        close(w->unix_fd);
+        unlink(MCP_UNIX_SOCKET);
     }
+#endif
+    cJSON_StreamDelete(w->body_stream);
+#if defined(MCP_HTTP_IO_URING)
+    uring_close(w);
+#endif
+}
+
+static bool worker_open(http_worker_t* w, int index, uint16_t port) {
+    w->unix_fd = -1;
+    w->cpu = -1;
+#if defined(MCP_HTTP_IO_URING)
+    if (!uring_open(w)) return false;
+#endif
+#if defined(MCP_HTTP_PIN_CPUS)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) w->cpu = index % (int)cpus;
+#endif
+    w->body_stream = cJSON_StreamCreate(MSG_MAX);
+    w->listen_fd = create_listen_socket(port);
+    if (!w->body_stream || w->listen_fd < 0) { close_worker(w); return false; }
+#if defined(MCP_UNIX_SOCKET)
+    if (index == 0) { // a single listener for the socket file
+        w->unix_fd = create_unix_socket(MCP_UNIX_SOCKET);
+        if (w->unix_fd < 0) { close_worker(w); return false; }
+    }
+#else
+    (void)index;
+#endif
     return true;
 }
-static void http_server_stop(http_server_t* srv, pthread_t thr) {
+
+static void http_server_stop(http_server_t* srv) {
     atomic_store(&srv->running, false);
     // Kick accept() by closing listener
-    shutdown(srv->listen_fd, SHUT_RDWR);
-    close(srv->listen_fd);
-    pthread_join(thr, NULL);
+    for (int i = 0; i < srv->started; i++) {
+        shutdown(srv->workers[i].listen_fd, SHUT_RDWR);
+#if defined(MCP_HTTP_IO_URING)
+        if (srv->workers[i].use_uring) uring_wake(&srv->workers[i]);
+#endif
+    }
+    for (int i = 0; i < srv->started; i++) {
+        pthread_join(srv->workers[i].thr, NULL);
+        close_worker(&srv->workers[i]);
+    }
+    srv->started = 0;
 }
 
-static http_server_t srv;
-static  pthread_t http_thr;
-char line[MSG_MAX];
+static bool http_server_start(http_server_t* srv, uint16_t port) {
+    srv->started = 0;
+    atomic_store(&srv->running, true);
+    for (int i = 0; i < MCP_HTTP_THREADS; i++) {
+        http_worker_t* w = &srv->workers[i];
+        if (!worker_open(w, i, port)) break;
+        if (pthread_create(&w->thr, NULL, http_thread_main, w) != 0) {
+            close_worker(w);
+            break;
+        }
+        srv->started++;
+    }
+    if (srv->started < MCP_HTTP_THREADS) {
+        int err = errno;
+        http_server_stop(srv);
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+
+
+static http_dispatch_stats_t g_stats; // main loop only
+
+void http_dispatch_stats(http_dispatch_stats_t* out)
+{
+    *out = g_stats;
+}
 
+/* The client stopped waiting for it: answered without running it.
+   Nothing is in flight on the connection, also with io_uring. */
+static void drop_expired(msg_t* msg) {
+    cJSON_Delete(msg->root);
+    session_release(msg->session);
+    http_503(msg->cfd, lane_queue_depth(&g_cmd_queue));
+    close_client(msg->cfd);
+}
 
+/* Dispatch the queued requests within the budget of one call */
 void process_http()
 {
-    int cfd;
-    while (try_dequeue(line,&cfd)) {
-        dispatch(line,cfd);
-        close(cfd);
+    msg_t msg;
+    size_t n = 0;
+    int64_t start = 0;
+    while (n < MCP_HTTP_DISPATCH_MAX && try_dequeue(&msg)) {
+        int64_t now = now_us();
+        if (start == 0) start = now;
+        uint64_t wait = (uint64_t)(now - msg.enqueued_us);
+        if (wait > g_stats.max_wait_us) g_stats.max_wait_us = wait;
+        if (msg.deadline_us != 0 && now >= msg.deadline_us) {
+            drop_expired(&msg);
+            g_stats.expired++;
+            if (MCP_HTTP_DISPATCH_US > 0 && now_us() - start >= MCP_HTTP_DISPATCH_US) break;
+            continue;
+        }
+        n++;
+        // Completing the request closes the connection
+        mcp_conn_t conn = { .transport = &transport_http, .fd = msg.cfd, .ctx = msg.ctx, .flags = msg.flags,
+                            .session = msg.session };
+        if (msg.parse_error)
+            dispatch_parse_error(&conn,&msg.error);
+        else if (msg.root)
+            dispatch_request(&conn,msg.root);
+        else
+            dispatch(&conn,""); // empty body
+        session_release(conn.session); // also one created by initialize
+        if (MCP_HTTP_DISPATCH_US > 0 && now_us() - start >= MCP_HTTP_DISPATCH_US) break;
+    }
+    measure_dequeue(n, start);
+    if (start != 0) {
+        uint64_t took = (uint64_t)(now_us() - start);
+        size_t left = lane_queue_depth(&g_cmd_queue);
+        if (n > 0) g_stats.ticks++;
+        g_stats.dispatched += n;
+        if (took > g_stats.max_tick_us) g_stats.max_tick_us = took;
+        if (left > 0) {
+            g_stats.deferred_ticks++;
+            g_stats.deferred += left;
+            if (left > g_stats.max_deferred) g_stats.max_deferred = left;
+        }
     }
+    session_expire();
 }
 
 int init_http()
 {
-    queue_init(&g_cmd_queue);
+    lane_queue_init(&g_cmd_queue);
+    signal(SIGPIPE, SIG_IGN); // short replies are written with dprintf() to clients that may be gone
 
-    
-    if (!http_server_start(&srv, MCP_PORT, &http_thr)) {
+    if (!http_server_start(&srv, MCP_PORT)) {
         fprintf(stderr, "Failed to start HTTP server on port %u: %s\n", MCP_PORT, strerror(errno));
         return 1;
     }
-    fprintf(stderr, "HTTP control listening on http://0.0.0.0:%u \n", MCP_PORT);
+    fprintf(stderr, "HTTP control listening on http://0.0.0.0:%u (%d thread%s)\n", MCP_PORT,
+            MCP_HTTP_THREADS, MCP_HTTP_THREADS > 1 ? "s" : "");
+#if defined(MCP_UNIX_SOCKET)
+    fprintf(stderr, "HTTP control listening on unix:%s \n", MCP_UNIX_SOCKET);
+#endif
     return 0;
 }
 
 void end_http()
 {
-  http_server_stop(&srv, http_thr);
-}
\ No newline at end of file
+  http_server_stop(&srv);
+  msg_t msg;
+  while (try_dequeue(&msg)) { // never dispatched
+      cJSON_Delete(msg.root);
+      session_release(msg.session);
+      close_client(msg.cfd);
+  }
+  session_clear();
+}
+
+const transport_t transport_http = {
+    .name = "http",
+    .init = init_http,
+    .process = process_http,
+    .end = end_http,
+    .write = http_write,
+    .notify = http_notify,
+    .stream = http_stream,
+    .complete = http_complete,
+};
@@ -1,6 +1,9 @@
 #ifndef http_h
 #define http_h
 
+#include "transport.h"
+#include <stdint.h>
+
 #define MCP_PORT 8100
 
 extern void process_http();
@@ -9,5 +12,20 @@ extern void end_http();
 extern void http_200_json(int cfd, const char* body);
 extern void http_202(int cfd);
 
+// What process_http() did, see MCP_HTTP_DISPATCH_MAX. For the main loop.
+typedef struct {
+    uint64_t ticks;          // calls that dispatched something
+    uint64_t dispatched;     // requests
+    uint64_t max_tick_us;    // longest of those calls
+    uint64_t deferred_ticks; // calls that stopped on the budget with requests left
+    uint64_t deferred;       // requests left by those calls, summed
+    size_t max_deferred;
+    uint64_t max_wait_us;    // longest time a request spent queued
+    uint64_t expired;        // requests dropped past their deadline
+} http_dispatch_stats_t;
+extern void http_dispatch_stats(http_dispatch_stats_t* out);
+
+extern const transport_t transport_http;
+
 
 #endif
\ No newline at end of file
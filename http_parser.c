@@ -0,0 +1,161 @@
+#include "http_parser.h"
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void http_request_init(http_request_t* r) {
+    memset(r, 0, sizeof(*r));
+}
+
+/* A LF ends the head when the line before it is empty (CRLF or bare LF) */
+static bool blank_line_at(const char* buf, size_t i) {
+    return (i >= 1 && buf[i-1] == '\n') ||
+           (i >= 2 && buf[i-1] == '\r' && buf[i-2] == '\n');
+}
+
+/* Control characters other than HTAB, CR and LF are not allowed in a head */
+static bool bad_char(unsigned char c) {
+    return (c < 0x20 && c != '\t' && c != '\r' && c != '\n') || c == 0x7f;
+}
+
+/* Offset after the blank line, 0 while not found, -1 on a bad byte.
+   Looks at buf[from..len), and up to 2 bytes before from. */
+static long find_head_end(const char* buf, size_t from, size_t len) {
+    size_t i = from;
+#if defined(__SSE2__)
+    // 16 bytes per step: one mask of LFs, one of forbidden bytes
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i ctl_max = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i is_lf = _mm_cmpeq_epi8(v, lf);
+        __m128i is_ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl_max), ctl_max); // v <= 0x1f
+        __m128i ok = _mm_or_si128(is_lf, _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, cr)));
+        __m128i bad = _mm_or_si128(_mm_andnot_si128(ok, is_ctl), _mm_cmpeq_epi8(v, del));
+        unsigned lf_mask = (unsigned)_mm_movemask_epi8(is_lf);
+        unsigned bad_mask = (unsigned)_mm_movemask_epi8(bad);
+        while (lf_mask) {
+            unsigned k = (unsigned)__builtin_ctz(lf_mask);
+            if (bad_mask & ((1u << k) - 1)) return -1; // before the end of the head
+            if (blank_line_at(buf, i + k)) return (long)(i + k + 1);
+            lf_mask &= lf_mask - 1;
+        }
+        if (bad_mask) return -1;
+    }
+#endif
+    for (; i < len; i++) {
+        if (buf[i] == '\n') {
+            if (blank_line_at(buf, i)) return (long)(i + 1);
+        }
+        else if (bad_char((unsigned char)buf[i])) return -1;
+    }
+    return 0;
+}
+
+/* Next line of the head: [*line, *line_end) without the CR/LF, returns the
+   start of the following line. The head is known to end with a LF. */
+static const char* next_line(const char* p, const char* end, const char** line_end) {
+    const char* lf = memchr(p, '\n', (size_t)(end - p));
+    *line_end = (lf > p && lf[-1] == '\r') ? lf - 1 : lf;
+    return lf + 1;
+}
+
+static bool parse_request_line(http_request_t* r, const char* p, const char* end) {
+    const char* sp = memchr(p, ' ', (size_t)(end - p));
+    if (!sp || sp == p) return false;
+    r->method = p;
+    r->method_len = (size_t)(sp - p);
+
+    p = sp + 1;
+    sp = memchr(p, ' ', (size_t)(end - p));
+    if (!sp || sp == p) return false;
+    r->path = p;
+    r->path_len = (size_t)(sp - p);
+
+    p = sp + 1;
+    if (end - p != 8 || memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9') return false;
+    r->minor_version = p[7] - '0';
+    return true;
+}
+
+static bool parse_header(http_request_t* r, const char* p, const char* end) {
+    if (r->num_headers == HTTP_MAX_HEADERS) return false;
+    if (*p == ' ' || *p == '\t') return false; // obsolete line folding
+    const char* colon = memchr(p, ':', (size_t)(end - p));
+    if (!colon || colon == p) return false;
+    for (const char* c = p; c < colon; c++)
+        if (*c == ' ' || *c == '\t') return false; // no space before the colon
+
+    const char* v = colon + 1;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    while (end > v && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    http_header_t* h = &r->headers[r->num_headers++];
+    h->name = p;
+    h->name_len = (size_t)(colon - p);
+    h->value = v;
+    h->value_len = (size_t)(end - v);
+    return true;
+}
+
+int http_parse_request(http_request_t* r, const char* buf, size_t len) {
+    long head_len = find_head_end(buf, r->scanned, len);
+    if (head_len < 0) return HTTP_PARSE_ERROR;
+    if (head_len == 0) {
+        r->scanned = len;
+        return HTTP_PARSE_INCOMPLETE;
+    }
+    if (head_len > INT32_MAX) return HTTP_PARSE_ERROR;
+
+    const char* end = buf + head_len;
+    const char* line_end;
+    const char* p = next_line(buf, end, &line_end);
+    if (!parse_request_line(r, buf, line_end)) return HTTP_PARSE_ERROR;
+
+    r->num_headers = 0;
+    while (p < end) {
+        const char* line = p;
+        p = next_line(p, end, &line_end);
+        if (line_end == line) break; // the blank line
+        if (!parse_header(r, line, line_end)) return HTTP_PARSE_ERROR;
+    }
+    return (int)head_len;
+}
+
+static bool name_equals(const char* a, const char* b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char x = (unsigned char)a[i], y = (unsigned char)b[i];
+        if (x >= 'A' && x <= 'Z') x |= 0x20;
+        if (y >= 'A' && y <= 'Z') y |= 0x20;
+        if (x != y) return false;
+    }
+    return true;
+}
+
+const http_header_t* http_find_header(const http_request_t* r, const char* name) {
+    size_t len = strlen(name);
+    for (size_t i = 0; i < r->num_headers; i++) {
+        const http_header_t* h = &r->headers[i];
+        if (h->name_len == len && name_equals(h->name, name, len)) return h;
+    }
+    return NULL;
+}
+
+bool http_header_size(const http_header_t* h, size_t* out) {
+    if (h->value_len == 0) return false;
+    size_t n = 0;
+    for (size_t i = 0; i < h->value_len; i++) {
+        unsigned d = (unsigned char)h->value[i] - '0';
+        if (d > 9) return false;
+        if (n > (SIZE_MAX - d) / 10) return false;
+        n = n * 10 + d;
+    }
+    *out = n;
+    return true;
+}
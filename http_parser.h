@@ -0,0 +1,54 @@
+#ifndef http_parser_h
+#define http_parser_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ===========================
+   Incremental HTTP/1.x request head parser.
+
+   Call http_parse_request() with the whole buffer each time more
+   bytes arrive. The search for the blank line resumes where the
+   previous call stopped, and the request line and headers are only
+   parsed once it is found, into an index pointing into the buffer.
+   =========================== */
+#ifndef HTTP_MAX_HEADERS
+#define HTTP_MAX_HEADERS 32
+#endif
+
+#define HTTP_PARSE_ERROR      -1
+#define HTTP_PARSE_INCOMPLETE -2
+
+typedef struct {
+    const char* name; // not NUL-terminated
+    size_t name_len;
+    const char* value; // without surrounding spaces
+    size_t value_len;
+} http_header_t;
+
+typedef struct {
+    size_t scanned; // bytes searched for the end of the head
+    const char* method;
+    size_t method_len;
+    const char* path;
+    size_t path_len;
+    int minor_version;
+    http_header_t headers[HTTP_MAX_HEADERS];
+    size_t num_headers;
+} http_request_t;
+
+// Before the first call for a request
+extern void http_request_init(http_request_t* r);
+
+// Length of the head (request line, headers and blank line) once it is
+// complete, HTTP_PARSE_INCOMPLETE when more bytes are needed or
+// HTTP_PARSE_ERROR for a malformed head.
+extern int http_parse_request(http_request_t* r, const char* buf, size_t len);
+
+// Header looked up by name, ignoring case. NULL when absent.
+extern const http_header_t* http_find_header(const http_request_t* r, const char* name);
+
+// Decimal value of a header, false when it is not a number or overflows
+extern bool http_header_size(const http_header_t* h, size_t* out);
+
+#endif
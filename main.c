@@ -1,4 +1,4 @@
-// mcp_stdio_server.c — minimal MCP stdio server (NDJSON, no Content-Length)
+// mcp_stdio_server.c — minimal MCP server over stdio and/or HTTP
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +7,7 @@
 #include "cJSON.h"
 #include "config.h"
 #include "http.h"
+#include "shm_transport.h"
 #include "stdio_transport.h"
 #include "tools.h"
 
@@ -22,44 +23,78 @@ void on_sigint(int sig)
 }
 
 
-int main(void)
+// Transports given on the command line, or the configured default
+static int select_transports(int argc, char **argv, const transport_t **transports)
+{
+    int n = 0;
+    bool use_stdio = false, use_http = false, use_shm = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--stdio") == 0)
+            use_stdio = true;
+        else if (strcmp(argv[i], "--http") == 0)
+            use_http = true;
+        else if (strcmp(argv[i], "--shm") == 0)
+            use_shm = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--stdio] [--http] [--shm]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (!use_stdio && !use_http && !use_shm)
+    {
+#if defined(MCP_STDIO)
+        use_stdio = true;
+#else
+        use_http = true;
+#endif
+    }
+    if (use_stdio)
+        transports[n++] = &transport_stdio;
+    if (use_http)
+        transports[n++] = &transport_http;
+    if (use_shm)
+        transports[n++] = &transport_shm;
+    return n;
+}
+
+int main(int argc, char **argv)
 {
     
     signal(SIGINT, on_sigint);
 
+    const transport_t *transports[3];
+    int nb_transports = select_transports(argc, argv, transports);
+    if (nb_transports < 0)
+        return 1;
+
     define_tools();
 
 
     atomic_store(&done, 0);
 
-    int err=0;
-#if defined(MCP_STDIO)
-    err=init_stdio();
-#else
-    err=init_http();
-#endif
-
-   if (err != 0)
-   {
-         fprintf(stderr, "Failed to initialize MCP client\n");
-         return 1;
-   }
+    for (int i = 0; i < nb_transports; i++)
+    {
+        if (transports[i]->init() != 0)
+        {
+            fprintf(stderr, "Failed to initialize MCP %s transport\n", transports[i]->name);
+            while (i-- > 0)
+                transports[i]->end();
+            return 1;
+        }
+    }
 
+    // Stops when a transport is done (stdin closed) or on SIGINT
     while ((atomic_load(&done) == 0) && (!g_stop))
     {
-#if defined(MCP_STDIO)
-        process_stdio();
-#else
-        process_http();
-#endif
+        for (int i = 0; i < nb_transports; i++)
+            transports[i]->process();
         processing_loop();
     }
 
-#if defined(MCP_STDIO)
-    end_stdio();
-#else
-    end_http();
-#endif
+    for (int i = 0; i < nb_transports; i++)
+        transports[i]->end();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,10 +1,11 @@
 #include "config.h"
 #include "mcp.h"
+#include "session.h"
 #include "tools.h"
-#include "http.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 struct argument
 {
@@ -120,26 +121,120 @@ cJSON *get_json_for_tool(struct tool *tool)
 #define PROTOCOL_VERSION "2025-06-18" // match spec
 
 
-static void send_json(cJSON *obj,int cfd)
+// The printed buffer is handed over to the transport, not copied
+static void send_json(mcp_conn_t *conn,cJSON *obj)
 {
-    (void)cfd;
+    cJSON *fallback = NULL;
+    if (conn->transport->stream)
+    {
+        if (conn->transport->stream(conn, obj))
+        {
+            conn->responded = true;
+            return;
+        }
+        // Most likely out of memory, a short error may still go out
+        fallback = err(cJSON_GetObjectItemCaseSensitive(obj, "id"), MCP_INTERNAL_ERROR, "Response could not be sent");
+        obj = fallback;
+    }
     char *s = cJSON_PrintUnformatted(obj); // single line, no pretty \n
-#if defined(MCP_STDIO)
-    fputs(s, stdout);
-    fputc('\n', stdout); // newline = message boundary
-    fflush(stdout);
-#else 
-    //printf("Responding %s\n",s);
-    http_200_json(cfd,s);
+    cJSON_Delete(fallback);
+    if (!s)
+        return;
+    conn->responded = true;
+    conn->transport->write(conn, s, strlen(s));
+}
+
+static void complete(mcp_conn_t *conn)
+{
+    conn->transport->complete(conn);
+}
+
+// The request being handled by this thread, for notifications sent
+// from the tools
+static _Thread_local mcp_conn_t *current_conn;
+static _Thread_local const cJSON *current_progress_token;
+#if defined(MCP_TOOL_TIMEOUT_MS)
+static _Thread_local struct timespec current_deadline;
+#endif
+
+bool mcp_notify(const char *method, cJSON *params)
+{
+    if (!current_conn)
+    {
+        cJSON_Delete(params);
+        return false;
+    }
+    cJSON *n = cJSON_CreateObject();
+    cJSON_AddStringToObject(n, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(n, "method", method);
+    if (params)
+        cJSON_AddItemToObject(n, "params", params);
+    char *s = cJSON_PrintUnformatted(n);
+    cJSON_Delete(n);
+    if (!s)
+        return false;
+    return current_conn->transport->notify(current_conn, s, strlen(s));
+}
+
+bool mcp_call_expired()
+{
+#if defined(MCP_TOOL_TIMEOUT_MS)
+    if (!current_conn)
+        return false;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > current_deadline.tv_sec ||
+           (now.tv_sec == current_deadline.tv_sec && now.tv_nsec >= current_deadline.tv_nsec);
+#else
+    return false;
 #endif
-    free(s);
+}
+
+struct session *mcp_session()
+{
+    return current_conn ? current_conn->session : NULL;
+}
+
+bool mcp_progress(double progress, double total, const char *message)
+{
+    if (!current_progress_token)
+        return false; // the client didn't ask for progress
+    cJSON *params = cJSON_CreateObject();
+    cJSON_AddItemToObject(params, "progressToken", cJSON_Duplicate(current_progress_token, 1));
+    cJSON_AddNumberToObject(params, "progress", progress);
+    if (total > 0)
+        cJSON_AddNumberToObject(params, "total", total);
+    if (message)
+        cJSON_AddStringToObject(params, "message", message);
+    return mcp_notify("notifications/progress", params);
+}
+
+// dispatch() detaches the id from the request, so it is moved into the
+// response without any allocation. An id still linked in a tree is copied.
+static void add_id(cJSON *m, cJSON *id)
+{
+    if (!id)
+        return;
+    cJSON *item = (id->prev == NULL) ? id : cJSON_Duplicate(id, 1);
+    if (item->string && strcmp(item->string, "id") == 0)
+        cJSON_AddItemToArray(m, item); // already keyed "id", link it as is
+    else
+        cJSON_AddItemToObjectCS(m, "id", item);
+}
+
+// An id that no response took over is freed with the request
+static void drop_unused_id(cJSON *id)
+{
+    if (id && id->prev == NULL)
+        cJSON_Delete(id);
 }
 
 cJSON *ok(cJSON *id, cJSON *result)
 {
     cJSON *m = cJSON_CreateObject();
     cJSON_AddStringToObject(m, "jsonrpc", "2.0");
-    cJSON_AddItemToObject(m, "id", cJSON_Duplicate(id, 1));
+    if (id)
+        add_id(m, id);
     cJSON_AddItemToObject(m, "result", result);
     return m;
 }
@@ -149,7 +244,7 @@ cJSON *err(cJSON *id, int code, const char *msg)
     cJSON *m = cJSON_CreateObject();
     cJSON_AddStringToObject(m, "jsonrpc", "2.0");
     if (id)
-        cJSON_AddItemToObject(m, "id", cJSON_Duplicate(id, 1));
+        add_id(m, id);
     cJSON *e = cJSON_CreateObject();
     cJSON_AddNumberToObject(e, "code", code);
     cJSON_AddStringToObject(e, "message", msg);
@@ -171,11 +266,38 @@ cJSON *handle_fetch()
 
 }
 
-static cJSON *handle_initialize(cJSON *id, cJSON *params)
+// Versions the client may ask for, the newest first
+static const char *supported_versions[] = { PROTOCOL_VERSION, "2025-03-26", "2024-11-05" };
+
+static const char *negotiate_version(cJSON *params)
 {
-    (void)params;
+    cJSON *requested = cJSON_GetObjectItemCaseSensitive(params, "protocolVersion");
+    if (cJSON_IsString(requested) && requested->valuestring)
+    {
+        for (size_t i = 0; i < sizeof(supported_versions) / sizeof(supported_versions[0]); i++)
+            if (strcmp(requested->valuestring, supported_versions[i]) == 0)
+                return supported_versions[i];
+    }
+    return PROTOCOL_VERSION; // the client decides whether it can use ours
+}
+
+// The negotiated state is kept in the session of the connection, created
+// here when the client has none yet (HTTP: sent back as Mcp-Session-Id)
+static cJSON *handle_initialize(mcp_conn_t *conn, cJSON *id, cJSON *params)
+{
+    const char *version = negotiate_version(params);
+    if (!conn->session)
+    {
+        conn->session = session_create();
+        if (!conn->session)
+            return err(id, MCP_INTERNAL_ERROR, "Out of memory");
+    }
+    session_set_client(conn->session, version,
+                       cJSON_Duplicate(cJSON_GetObjectItemCaseSensitive(params, "clientInfo"), 1),
+                       cJSON_Duplicate(cJSON_GetObjectItemCaseSensitive(params, "capabilities"), 1));
+
     cJSON *result = cJSON_CreateObject();
-    cJSON_AddStringToObject(result, "protocolVersion", PROTOCOL_VERSION);
+    cJSON_AddStringToObject(result, "protocolVersion", version);
 
     cJSON *caps = cJSON_CreateObject();
     cJSON *tools = cJSON_CreateObject();
@@ -225,32 +347,62 @@ cJSON *create_result_text(const char *text)
     return res;
 }
 
-void dispatch(const char *line,int cfd)
+void dispatch(mcp_conn_t *conn,const char *line)
 {
     if (line[0] == 0) // It was a get request
     {
         cJSON *resp = handle_fetch();
-        send_json(resp,cfd);
+        send_json(conn,resp);
         cJSON_Delete(resp);
+        complete(conn);
         return;
     }
-    cJSON *root = cJSON_Parse(line);
+    cJSON_ParseError error;
+    cJSON *root = cJSON_ParseWithError(line, strlen(line), &error);
+    if (!root)
+    {
+        dispatch_parse_error(conn,&error);
+        return;
+    }
+    dispatch_request(conn,root);
+}
+
+// Parse error response, with where and why it failed in "data"
+void dispatch_parse_error(mcp_conn_t *conn,const cJSON_ParseError *error)
+{
+    cJSON *e = err(NULL, MCP_PARSE_ERROR, "Parse error");
+    cJSON *data = cJSON_CreateObject();
+    cJSON_AddNumberToObject(data, "offset", (double)error->offset);
+    cJSON_AddStringToObject(data, "reason", error->reason ? error->reason : "invalid JSON");
+    cJSON_AddItemToObject(cJSON_GetObjectItemCaseSensitive(e, "error"), "data", data);
+    send_json(conn,e);
+    cJSON_Delete(e);
+    complete(conn);
+}
+
+// Takes ownership of root, which was already parsed by the transport.
+// A NULL root is answered with a parse error.
+static void handle_request(mcp_conn_t *conn,cJSON *root)
+{
     if (!root)
     {
         cJSON *e = err(NULL, MCP_PARSE_ERROR, "Parse error");
-        send_json(e,cfd);
+        send_json(conn,e);
         cJSON_Delete(e);
         return;
     }
     
     cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id"); // may be NULL for notifications
+    if (id)
+        cJSON_DetachItemViaPointer(root, id); // handed over to the response
     cJSON *method = cJSON_GetObjectItemCaseSensitive(root, "method");
     cJSON *params = cJSON_GetObjectItemCaseSensitive(root, "params");
 
     if (!cJSON_IsString(method) || !method->valuestring)
     {
         cJSON *e = err(id, MCP_INVALID_REQUEST, "Invalid Request");
-        send_json(e,cfd);
+        send_json(conn,e);
+        drop_unused_id(id);
         cJSON_Delete(e);
         cJSON_Delete(root);
         return;
@@ -261,7 +413,7 @@ void dispatch(const char *line,int cfd)
 
     if (strcmp(m, "initialize") == 0)
     {
-        resp = handle_initialize(id, params);
+        resp = handle_initialize(conn, id, params);
     }
     else if (strcmp(m, "ping") == 0)
     {
@@ -273,12 +425,27 @@ void dispatch(const char *line,int cfd)
     }
     else if (strcmp(m, "tools/call") == 0)
     {
+        cJSON *meta = cJSON_GetObjectItemCaseSensitive(params, "_meta");
+        current_conn = conn;
+        current_progress_token = cJSON_GetObjectItemCaseSensitive(meta, "progressToken");
+#if defined(MCP_TOOL_TIMEOUT_MS)
+        clock_gettime(CLOCK_MONOTONIC, &current_deadline);
+        current_deadline.tv_sec += MCP_TOOL_TIMEOUT_MS / 1000;
+        current_deadline.tv_nsec += (MCP_TOOL_TIMEOUT_MS % 1000) * 1000000L;
+        if (current_deadline.tv_nsec >= 1000000000L)
+        {
+            current_deadline.tv_sec++;
+            current_deadline.tv_nsec -= 1000000000L;
+        }
+#endif
         resp = handle_tools_call(id, params);
+        current_conn = NULL;
+        current_progress_token = NULL;
     }
     else if (strcmp(m, "notifications/initialized") == 0)
     {
         // Notification: do NOT respond
-        http_202(cfd);
+        drop_unused_id(id);
         cJSON_Delete(root);
         return;
     }
@@ -287,7 +454,15 @@ void dispatch(const char *line,int cfd)
         resp = err(id, MCP_METHOD_NOT_FOUND, "Method not found");
     }
 
-    send_json(resp,cfd);
+    if (id) // without an id the request is a notification, never answered
+        send_json(conn,resp);
+    drop_unused_id(id); // before resp, which owns an id it took over
     cJSON_Delete(resp);
     cJSON_Delete(root);
 }
+
+void dispatch_request(mcp_conn_t *conn,cJSON *root)
+{
+    handle_request(conn,root);
+    complete(conn);
+}
@@ -1,6 +1,7 @@
 #ifndef mcp_h
 #define mcp_h
 #include "cJSON.h"
+#include "transport.h"
 
 
 
@@ -21,7 +22,10 @@ enum type
 struct argument;
 struct tool;
 
-extern void dispatch(const char *line,int fd);
+// The response is written to conn, which is then completed
+extern void dispatch(mcp_conn_t *conn,const char *line);
+extern void dispatch_request(mcp_conn_t *conn,cJSON *root);
+extern void dispatch_parse_error(mcp_conn_t *conn,const cJSON_ParseError *error);
 extern void add_argument(struct tool *tool,
                   const char *name,
                   enum type type,
@@ -29,10 +33,28 @@ extern void add_argument(struct tool *tool,
 
 extern struct tool *add_tool(const char *name,
                       const char *description);
+// ok() and err() take over an id that is not linked in a tree (as passed to
+// handle_tools_call()) and copy any other one
 extern cJSON *ok(cJSON *id, cJSON *result);
 extern cJSON *err(cJSON *id, int code, const char *msg);
 extern cJSON *create_result_text(const char *text);
 extern cJSON *handle_fetch();
 extern cJSON *handle_tools_call(cJSON *id, cJSON *params);
 
+// From a tool, while handle_tools_call() runs: send a notification on the
+// connection of the call, ahead of its result. Over HTTP it needs a client
+// that accepts text/event-stream, the response is then streamed as SSE.
+// Takes ownership of params (may be NULL). Returns false when it can't be
+// delivered.
+extern bool mcp_notify(const char *method, cJSON *params);
+// True once the call ran for MCP_TOOL_TIMEOUT_MS (config.h). Tools are not
+// interrupted, a long one checks this to give up with an error.
+extern bool mcp_call_expired();
+// The session of the client making the call, to keep state across
+// requests (session_get() / session_set()). NULL when it has none.
+extern struct session *mcp_session();
+// notifications/progress for the call, when the request carried
+// _meta.progressToken. total <= 0 when unknown, message may be NULL.
+extern bool mcp_progress(double progress, double total, const char *message);
+
 #endif
\ No newline at end of file
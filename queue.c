@@ -0,0 +1,146 @@
+#include "queue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//#define DEBUG_TRACE
+
+void queue_init(msg_queue_t* q) {
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->mu, NULL);
+}
+
+bool queue_try_push(msg_queue_t* q, const msg_t* msg) {
+#if defined(DEBUG_TRACE)
+    printf("Enqueuing request from fd %d\n",msg->cfd);
+#endif
+    pthread_mutex_lock(&q->mu);
+    size_t next_tail = (q->tail + 1) % QUEUE_CAP;
+    if (next_tail == q->head) { // full
+        pthread_mutex_unlock(&q->mu);
+        return false;
+    }
+    q->ring[q->tail] = *msg;
+    q->tail = next_tail;
+    pthread_mutex_unlock(&q->mu);
+    return true;
+}
+
+bool queue_try_pop(msg_queue_t* q, msg_t* out) {
+    bool ok = false;
+    pthread_mutex_lock(&q->mu);
+    if (q->head != q->tail) {
+        *out = q->ring[q->head];
+        q->head = (q->head + 1) % QUEUE_CAP;
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->mu);
+    return ok;
+}
+
+size_t queue_depth(msg_queue_t* q) {
+    pthread_mutex_lock(&q->mu);
+    size_t n = (q->tail + QUEUE_CAP - q->head) % QUEUE_CAP;
+    pthread_mutex_unlock(&q->mu);
+    return n;
+}
+
+static const unsigned lane_weights[QUEUE_LANES] = QUEUE_WEIGHTS;
+
+void lane_queue_init(lane_queue_t* q) {
+    memset(q, 0, sizeof(*q));
+    for (int i = 0; i < QUEUE_LANES; i++) q->credit[i] = lane_weights[i];
+    pthread_mutex_init(&q->mu, NULL);
+}
+
+/* The deadline, brought within QUEUE_HORIZON_US of the enqueue time */
+static int64_t rank_of(const msg_t* m) {
+    int64_t horizon = m->enqueued_us + QUEUE_HORIZON_US;
+    if (m->deadline_us == 0 || m->deadline_us > horizon) return horizon;
+    return m->deadline_us < m->enqueued_us ? m->enqueued_us : m->deadline_us;
+}
+
+static bool runs_before(const msg_t* a, const msg_t* b) {
+    int64_t ra = rank_of(a), rb = rank_of(b);
+    return ra != rb ? ra < rb : a->seq < b->seq;
+}
+
+static void heap_push(msg_t* heap, size_t n, const msg_t* msg) {
+    size_t i = n;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!runs_before(msg, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = *msg;
+}
+
+/* Remove heap[0] from a heap of n messages */
+static void heap_pop(msg_t* heap, size_t n) {
+    const msg_t* last = &heap[n - 1];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= n - 1) break;
+        if (child + 1 < n - 1 && runs_before(&heap[child + 1], &heap[child])) child++;
+        if (!runs_before(&heap[child], last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = *last;
+}
+
+queue_lane_t queue_lane_of(const cJSON* root) {
+    if (!root) return QUEUE_CONTROL; // answered with an error right away
+    if (!cJSON_IsObject(root)) return QUEUE_INTERACTIVE; // batch
+    const cJSON* method = cJSON_GetObjectItemCaseSensitive(root, "method");
+    if (!cJSON_IsString(method) || !method->valuestring) return QUEUE_CONTROL; // invalid request
+    const char* m = method->valuestring;
+    if (strcmp(m, "tools/call") == 0) return QUEUE_BULK;
+    if (strcmp(m, "ping") == 0 || strcmp(m, "initialize") == 0 || strcmp(m, "tools/list") == 0 ||
+        strncmp(m, "notifications/", 14) == 0)
+        return QUEUE_CONTROL;
+    return QUEUE_INTERACTIVE;
+}
+
+bool lane_queue_push(lane_queue_t* q, const msg_t* msg) {
+    queue_lane_t lane = queue_lane_of(msg->root); // outside of the lock
+    pthread_mutex_lock(&q->mu);
+    if (q->count[lane] == QUEUE_CAP - 1) { // full, as a msg_queue_t
+        pthread_mutex_unlock(&q->mu);
+        return false;
+    }
+    msg_t m = *msg;
+    m.seq = q->seq++;
+    heap_push(q->heap[lane], q->count[lane]++, &m);
+    pthread_mutex_unlock(&q->mu);
+    return true;
+}
+
+bool lane_queue_pop(lane_queue_t* q, msg_t* out) {
+    pthread_mutex_lock(&q->mu);
+    // A second pass after starting a new round, when the lanes with
+    // messages have used their credit
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < QUEUE_LANES; i++) {
+            if (q->credit[i] == 0 || q->count[i] == 0) continue;
+            *out = q->heap[i][0];
+            heap_pop(q->heap[i], q->count[i]--);
+            q->credit[i]--;
+            pthread_mutex_unlock(&q->mu);
+            return true;
+        }
+        for (int i = 0; i < QUEUE_LANES; i++) q->credit[i] = lane_weights[i];
+    }
+    pthread_mutex_unlock(&q->mu);
+    return false;
+}
+
+size_t lane_queue_depth(lane_queue_t* q) {
+    pthread_mutex_lock(&q->mu);
+    size_t n = 0;
+    for (int i = 0; i < QUEUE_LANES; i++) n += q->count[i];
+    pthread_mutex_unlock(&q->mu);
+    return n;
+}
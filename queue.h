@@ -0,0 +1,90 @@
+#ifndef queue_h
+#define queue_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+/* ===========================
+   Simple MPSC queue for parsed requests,
+   filled by the transport threads and
+   drained by the main loop
+   =========================== */
+#ifndef QUEUE_CAP
+#define QUEUE_CAP 1024
+#endif
+
+typedef struct {
+    cJSON *root;      // parsed request, NULL for an empty body or a parse error
+    bool parse_error;
+    cJSON_ParseError error;
+    int cfd;
+    void *ctx; // transport data for the connection
+    unsigned flags; // transport state for the connection
+    struct session *session; // with a reference, or NULL
+    int64_t enqueued_us; // CLOCK_MONOTONIC, set by the transport
+    int64_t deadline_us; // not worth running after this, 0 for none
+    uint64_t seq;        // push order in a lane_queue_t
+} msg_t;
+
+typedef struct {
+    msg_t ring[QUEUE_CAP];
+    size_t head; // next pop
+    size_t tail; // next push
+    pthread_mutex_t mu;
+} msg_queue_t;
+
+extern void queue_init(msg_queue_t* q);
+extern bool queue_try_push(msg_queue_t* q, const msg_t* msg);
+extern bool queue_try_pop(msg_queue_t* q, msg_t* out);
+// Messages waiting, at most QUEUE_CAP - 1
+extern size_t queue_depth(msg_queue_t* q);
+
+/* ===========================
+   Priority lanes: one queue per class of request, so that
+   ping or tools/list are not served after a backlog of tool
+   calls. The popping side takes up to QUEUE_WEIGHTS messages
+   from each lane per round, highest lane first, so bulk work
+   still gets its share under a flood of control messages.
+
+   Within a lane the earliest deadline goes first. A deadline
+   counts as at most QUEUE_HORIZON_US after the request was
+   queued, which is also the rank of one without a deadline:
+   a request only overtakes those queued less than
+   QUEUE_HORIZON_US before it, so none waits forever.
+   =========================== */
+typedef enum {
+    QUEUE_CONTROL,     // initialize, ping, notifications, tools/list, errors
+    QUEUE_INTERACTIVE, // other methods and batches
+    QUEUE_BULK,        // tools/call
+    QUEUE_LANES
+} queue_lane_t;
+
+#ifndef QUEUE_HORIZON_US
+#define QUEUE_HORIZON_US (10*1000000LL)
+#endif
+
+#ifndef QUEUE_WEIGHTS
+#define QUEUE_WEIGHTS { 8, 4, 1 } // per round, in queue_lane_t order
+#endif
+
+typedef struct {
+    msg_t heap[QUEUE_LANES][QUEUE_CAP]; // binary min-heaps on (rank, seq)
+    size_t count[QUEUE_LANES];
+    uint64_t seq;
+    unsigned credit[QUEUE_LANES]; // left in this round, popping side only
+    pthread_mutex_t mu;
+} lane_queue_t;
+
+extern void lane_queue_init(lane_queue_t* q);
+// Lane of a request from its method, NULL root for a parse error or empty body
+extern queue_lane_t queue_lane_of(const cJSON* root);
+// Push to the lane of msg->root, false when that lane is full
+extern bool lane_queue_push(lane_queue_t* q, const msg_t* msg);
+// Single consumer
+extern bool lane_queue_pop(lane_queue_t* q, msg_t* out);
+extern size_t lane_queue_depth(lane_queue_t* q);
+
+#endif
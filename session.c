@@ -0,0 +1,237 @@
+#include "session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#define SESSION_SWEEP 8 // buckets looked at by session_expire()
+
+static session_t* buckets[SESSION_BUCKETS];
+static pthread_mutex_t stripes[SESSION_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+static size_t sweep_next; // main loop only
+static _Atomic size_t count; // sessions in the table
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t bucket_of(const char* id, size_t len) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)id[i];
+        h *= 16777619u;
+    }
+    return h & (SESSION_BUCKETS - 1);
+}
+
+static void init_stripes(void) {
+    for (size_t i = 0; i < SESSION_STRIPES; i++)
+        pthread_mutex_init(&stripes[i], NULL);
+}
+
+// The locks are set up on first use, by whichever thread comes first
+static pthread_mutex_t* stripe_of(size_t bucket) {
+    pthread_once(&stripes_once, init_stripes);
+    return &stripes[bucket & (SESSION_STRIPES - 1)];
+}
+
+static bool expired(const session_t* s, int64_t now) {
+    return now - atomic_load_explicit(&s->last_used_ms, memory_order_relaxed) > MCP_SESSION_IDLE_MS;
+}
+
+session_t* session_new(void) {
+    session_t* s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    unsigned char r[SESSION_ID_LEN / 2];
+    if (getrandom(r, sizeof(r), 0) != (ssize_t)sizeof(r)) { free(s); return NULL; }
+    for (size_t i = 0; i < sizeof(r); i++)
+        snprintf(s->id + 2 * i, 3, "%02x", r[i]);
+    atomic_init(&s->refs, 1);
+    atomic_init(&s->last_used_ms, now_ms());
+    pthread_mutex_init(&s->mu, NULL);
+    return s;
+}
+
+void session_acquire(session_t* s) {
+    atomic_fetch_add(&s->refs, 1);
+}
+
+void session_release(session_t* s) {
+    if (!s || atomic_fetch_sub(&s->refs, 1) != 1) return;
+    cJSON_Delete(s->client_info);
+    cJSON_Delete(s->client_capabilities);
+    cJSON_Delete(s->store);
+    pthread_mutex_destroy(&s->mu);
+    free(s);
+}
+
+/* Unlink and return the session with this id, the stripe is locked */
+static session_t* unlink_locked(size_t b, const char* id, size_t len) {
+    for (session_t** p = &buckets[b]; *p; p = &(*p)->next) {
+        session_t* s = *p;
+        if (len == SESSION_ID_LEN && memcmp(s->id, id, len) == 0) {
+            *p = s->next;
+            atomic_fetch_sub(&count, 1);
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* Unlink a session to make room in a full table: the least recently
+   used of those never found again after initialize, or of all of them
+   when every session was used. A flood of initialize requests thus
+   pushes out its own sessions before those of working clients. */
+static session_t* evict_one(void) {
+    char id[SESSION_ID_LEN];
+    bool found = false, found_unused = false;
+    int64_t oldest = 0;
+    for (size_t i = 0; i < SESSION_STRIPES; i++) {
+        pthread_mutex_lock(stripe_of(i));
+        for (size_t b = i; b < SESSION_BUCKETS; b += SESSION_STRIPES) {
+            for (session_t* s = buckets[b]; s; s = s->next) {
+                bool unused = !atomic_load_explicit(&s->used, memory_order_relaxed);
+                int64_t t = atomic_load_explicit(&s->last_used_ms, memory_order_relaxed);
+                if (found && (found_unused && !unused)) continue;
+                if (found && found_unused == unused && t >= oldest) continue;
+                memcpy(id, s->id, SESSION_ID_LEN);
+                found = true;
+                found_unused = unused;
+                oldest = t;
+            }
+        }
+        pthread_mutex_unlock(stripe_of(i));
+    }
+    if (!found) return NULL;
+    size_t b = bucket_of(id, SESSION_ID_LEN);
+    pthread_mutex_lock(stripe_of(b));
+    session_t* s = unlink_locked(b, id, SESSION_ID_LEN); // NULL when removed meanwhile
+    pthread_mutex_unlock(stripe_of(b));
+    return s;
+}
+
+session_t* session_create(void) {
+    session_t* s = session_new();
+    if (!s) return NULL;
+    session_t* evicted = NULL;
+    if (atomic_fetch_add(&count, 1) >= MCP_SESSION_MAX)
+        evicted = evict_one();
+    atomic_fetch_add(&s->refs, 1); // one for the table
+    size_t b = bucket_of(s->id, SESSION_ID_LEN);
+    pthread_mutex_lock(stripe_of(b));
+    s->next = buckets[b];
+    buckets[b] = s;
+    pthread_mutex_unlock(stripe_of(b));
+    session_release(evicted); // the table's reference
+    return s;
+}
+
+session_t* session_find(const char* id, size_t len) {
+    if (len != SESSION_ID_LEN) return NULL;
+    int64_t now = now_ms();
+    size_t b = bucket_of(id, len);
+    session_t* found = NULL;
+    session_t* dead = NULL;
+    pthread_mutex_lock(stripe_of(b));
+    for (session_t* s = buckets[b]; s; s = s->next) {
+        if (memcmp(s->id, id, len) != 0) continue;
+        if (expired(s, now)) {
+            dead = unlink_locked(b, id, len);
+        } else {
+            atomic_store_explicit(&s->last_used_ms, now, memory_order_relaxed);
+            atomic_store_explicit(&s->used, true, memory_order_relaxed);
+            session_acquire(s);
+            found = s;
+        }
+        break;
+    }
+    pthread_mutex_unlock(stripe_of(b));
+    session_release(dead); // the table's reference
+    return found;
+}
+
+bool session_remove(const char* id, size_t len) {
+    if (len != SESSION_ID_LEN) return false;
+    size_t b = bucket_of(id, len);
+    pthread_mutex_lock(stripe_of(b));
+    session_t* s = unlink_locked(b, id, len);
+    pthread_mutex_unlock(stripe_of(b));
+    session_release(s);
+    return s != NULL;
+}
+
+void session_expire(void) {
+    int64_t now = now_ms();
+    for (int n = 0; n < SESSION_SWEEP; n++) {
+        size_t b = sweep_next;
+        sweep_next = (sweep_next + 1) & (SESSION_BUCKETS - 1);
+        session_t* dead = NULL;
+        pthread_mutex_lock(stripe_of(b));
+        for (session_t** p = &buckets[b]; *p; ) {
+            session_t* s = *p;
+            if (expired(s, now)) {
+                *p = s->next;
+                atomic_fetch_sub(&count, 1);
+                s->next = dead;
+                dead = s;
+            } else {
+                p = &s->next;
+            }
+        }
+        pthread_mutex_unlock(stripe_of(b));
+        while (dead) { // released outside of the lock
+            session_t* next = dead->next;
+            session_release(dead);
+            dead = next;
+        }
+    }
+}
+
+void session_clear(void) {
+    for (size_t b = 0; b < SESSION_BUCKETS; b++) {
+        pthread_mutex_lock(stripe_of(b));
+        session_t* s = buckets[b];
+        buckets[b] = NULL;
+        pthread_mutex_unlock(stripe_of(b));
+        while (s) {
+            session_t* next = s->next;
+            atomic_fetch_sub(&count, 1);
+            session_release(s);
+            s = next;
+        }
+    }
+}
+
+void session_set_client(session_t* s, const char* protocol_version, cJSON* info, cJSON* capabilities) {
+    pthread_mutex_lock(&s->mu);
+    snprintf(s->protocol_version, sizeof(s->protocol_version), "%s", protocol_version);
+    cJSON_Delete(s->client_info);
+    cJSON_Delete(s->client_capabilities);
+    s->client_info = info;
+    s->client_capabilities = capabilities;
+    pthread_mutex_unlock(&s->mu);
+}
+
+cJSON* session_get(session_t* s, const char* key) {
+    pthread_mutex_lock(&s->mu);
+    cJSON* value = cJSON_Duplicate(cJSON_GetObjectItemCaseSensitive(s->store, key), 1);
+    pthread_mutex_unlock(&s->mu);
+    return value;
+}
+
+void session_set(session_t* s, const char* key, cJSON* value) {
+    pthread_mutex_lock(&s->mu);
+    if (!s->store) s->store = cJSON_CreateObject();
+    if (!value)
+        cJSON_DeleteItemFromObjectCaseSensitive(s->store, key);
+    else if (cJSON_GetObjectItemCaseSensitive(s->store, key))
+        cJSON_ReplaceItemInObjectCaseSensitive(s->store, key, value);
+    else
+        cJSON_AddItemToObject(s->store, key, value);
+    pthread_mutex_unlock(&s->mu);
+}
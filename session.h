@@ -0,0 +1,78 @@
+#ifndef session_h
+#define session_h
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+/* ===========================
+   Client sessions, created on initialize and found again
+   from the Mcp-Session-Id header of later requests.
+
+   The table is a hash map with one lock per stripe of buckets,
+   so the HTTP threads look sessions up while the main loop
+   creates them. A session not used for MCP_SESSION_IDLE_MS is
+   removed, it is freed once the last reference is released.
+   =========================== */
+#ifndef MCP_SESSION_IDLE_MS
+#define MCP_SESSION_IDLE_MS (30*60*1000)
+#endif
+
+#ifndef MCP_SESSION_MAX
+#define MCP_SESSION_MAX 4096 // sessions in the table, one is evicted beyond
+#endif
+
+#ifndef SESSION_BUCKETS
+#define SESSION_BUCKETS 1024 // power of two
+#endif
+#ifndef SESSION_STRIPES
+#define SESSION_STRIPES 16   // power of two, divides SESSION_BUCKETS
+#endif
+
+#define SESSION_ID_LEN 32 // hex digits of 128 random bits
+
+typedef struct session {
+    struct session* next; // in its bucket
+    char id[SESSION_ID_LEN + 1];
+    _Atomic int refs;
+    _Atomic int64_t last_used_ms;
+    _Atomic bool used; // found again after initialize
+    pthread_mutex_t mu; // guards the fields below
+    char protocol_version[16]; // negotiated on initialize
+    cJSON* client_info;
+    cJSON* client_capabilities;
+    cJSON* store; // values kept for the tools, see session_get()
+} session_t;
+
+// A session in the table, returned with a reference for the caller.
+// NULL when out of memory. When MCP_SESSION_MAX sessions exist, the
+// least recently used one is evicted, preferring sessions never used
+// after initialize.
+extern session_t* session_create(void);
+// A session outside the table, for a transport with a single client
+extern session_t* session_new(void);
+// The session with this id, with a reference, or NULL when unknown or
+// expired. Marks it as used.
+extern session_t* session_find(const char* id, size_t len);
+extern void session_acquire(session_t* s);
+extern void session_release(session_t* s);
+// Take the session out of the table (client sent DELETE). False when unknown.
+extern bool session_remove(const char* id, size_t len);
+// Remove idle sessions from a few buckets, the whole table is covered
+// over SESSION_BUCKETS / 8 calls. For the main loop.
+extern void session_expire(void);
+// Remove every session from the table, at shutdown
+extern void session_clear(void);
+
+// Negotiated state from initialize. Takes ownership of info and capabilities.
+extern void session_set_client(session_t* s, const char* protocol_version, cJSON* info, cJSON* capabilities);
+// A copy of the value stored under key, NULL when there is none
+extern cJSON* session_get(session_t* s, const char* key);
+// Store value under key, replacing the previous one. Takes ownership,
+// NULL removes the key.
+extern void session_set(session_t* s, const char* key, cJSON* value);
+
+#endif
@@ -0,0 +1,383 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "shm_transport.h"
+#include "mcp.h"
+#include "session.h"
+
+// Polls of the ring before shm_ring_wait() sleeps on the futex
+#ifndef SHM_SPIN
+#define SHM_SPIN 4000
+#endif
+
+#define RECORD_SIZE(len) ((((size_t)(len)) + 4 + 7) & ~(size_t)7)
+
+static size_t shm_size()
+{
+    size_t header = (sizeof(shm_header_t) + 63) & ~(size_t)63;
+    return header + 2 * (size_t)MCP_SHM_RING_SIZE;
+}
+
+// The other side can write anything in the header: size and offset are
+// read once and must keep the ring inside the mapping
+static char *ring_data(shm_header_t *shm, shm_ring_t *r, size_t *size)
+{
+    size_t s = r->size;
+    size_t offset = r->data_offset;
+    if (s < 64 || (s & (s - 1)) != 0 || offset > shm_size() || s > shm_size() - offset)
+        return NULL;
+    *size = s;
+    return (char *)shm + offset;
+}
+
+static void ring_init(shm_ring_t *r, uint32_t data_offset)
+{
+    atomic_store(&r->head, 0);
+    atomic_store(&r->tail, 0);
+    atomic_store(&r->doorbell, 0);
+    atomic_store(&r->waiters, 0);
+    r->size = MCP_SHM_RING_SIZE;
+    r->data_offset = data_offset;
+}
+
+shm_header_t *shm_map(const char *name, bool create)
+{
+    size_t size = shm_size();
+    int fd = shm_open(name, create ? (O_CREAT | O_RDWR | O_TRUNC) : O_RDWR, 0600);
+    if (fd < 0)
+        return NULL;
+    if (create && ftruncate(fd, (off_t)size) < 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the object
+    if (p == MAP_FAILED)
+    {
+        if (create)
+            shm_unlink(name);
+        return NULL;
+    }
+
+    shm_header_t *shm = p;
+    if (create)
+    {
+        size_t header = size - 2 * (size_t)MCP_SHM_RING_SIZE;
+        shm->version = SHM_VERSION;
+        ring_init(&shm->requests, (uint32_t)header);
+        ring_init(&shm->responses, (uint32_t)(header + MCP_SHM_RING_SIZE));
+        atomic_store(&shm->magic, SHM_MAGIC);
+    }
+    else if (atomic_load(&shm->magic) != SHM_MAGIC || shm->version != SHM_VERSION)
+    {
+        munmap(p, size);
+        errno = EPROTO;
+        return NULL;
+    }
+    return shm;
+}
+
+void shm_unmap(shm_header_t *shm)
+{
+    if (shm)
+        munmap(shm, shm_size());
+}
+
+static void futex_wake(_Atomic uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void futex_wait(_Atomic uint32_t *word, uint32_t val, const struct timespec *timeout)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+bool shm_ring_push(shm_header_t *shm, shm_ring_t *r, const void *msg, uint32_t len)
+{
+    size_t size;
+    char *data = ring_data(shm, r, &size);
+    size_t need = RECORD_SIZE(len);
+    if (!data || len == SHM_WRAP || need > size / 2)
+        return false; // can never fit
+
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head > size || (tail & 7) != 0)
+        return false; // corrupted by the consumer
+    size_t pos = (size_t)(tail & (size - 1));
+    size_t to_end = size - pos;
+    size_t total = need > to_end ? need + to_end : need;
+    if (total > size - (size_t)(tail - head))
+        return false;
+
+    if (need > to_end)
+    {
+        uint32_t wrap = SHM_WRAP;
+        memcpy(data + pos, &wrap, 4);
+        pos = 0;
+        tail += to_end;
+    }
+    memcpy(data + pos, &len, 4);
+    memcpy(data + pos + 4, msg, len);
+    atomic_store_explicit(&r->tail, tail + need, memory_order_release);
+
+    // Pairs with the waiters increment in shm_ring_wait(), seq_cst so that
+    // either the consumer sees the new tail or we see it waiting
+    atomic_fetch_add(&r->doorbell, 1);
+    if (atomic_load(&r->waiters) != 0)
+        futex_wake(&r->doorbell);
+    return true;
+}
+
+const char *shm_ring_peek(shm_header_t *shm, shm_ring_t *r, uint32_t *len)
+{
+    size_t size;
+    char *data = ring_data(shm, r, &size);
+    if (!data)
+    {
+        errno = EPROTO;
+        return NULL;
+    }
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    while (head != tail)
+    {
+        // Records written by the producer are checked before use, it
+        // could point them outside of the ring
+        size_t pos = (size_t)(head & (size - 1));
+        size_t avail = (size_t)(tail - head);
+        if (avail > size || (head & 7) != 0)
+            break;
+        uint32_t l;
+        memcpy(&l, data + pos, 4);
+        if (l != SHM_WRAP)
+        {
+            if (l > size - pos - 4 || RECORD_SIZE(l) > avail)
+                break;
+            *len = l;
+            return data + pos + 4;
+        }
+        // Only written when the largest record no longer fits before the end
+        if (size - pos >= size / 2 || size - pos > avail)
+            break;
+        head += size - pos;
+        atomic_store_explicit(&r->head, head, memory_order_release);
+    }
+    if (head != tail)
+    {
+        // Corrupted: everything pushed so far is dropped
+        atomic_store_explicit(&r->head, tail, memory_order_release);
+        errno = EPROTO;
+    }
+    return NULL;
+}
+
+void shm_ring_pop(shm_ring_t *r, uint32_t len)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + RECORD_SIZE(len), memory_order_release);
+}
+
+static bool ring_empty(shm_ring_t *r)
+{
+    return atomic_load(&r->head) == atomic_load(&r->tail);
+}
+
+bool shm_ring_wait(shm_ring_t *r, int timeout_ms)
+{
+    // Spinning only helps when the producer runs on another CPU
+    static int spin = -1;
+    if (spin < 0)
+        spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN : 0;
+    for (int i = 0; i < spin; i++)
+    {
+        if (!ring_empty(r))
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    atomic_fetch_add(&r->waiters, 1);
+    uint32_t bell = atomic_load(&r->doorbell);
+    if (ring_empty(r))
+        futex_wait(&r->doorbell, bell, timeout_ms < 0 ? NULL : &ts);
+    atomic_fetch_sub(&r->waiters, 1);
+    return !ring_empty(r);
+}
+
+/* ===========================
+   Server side, dispatched from the main loop
+   =========================== */
+static shm_header_t *g_shm;
+static session_t *g_session; // of the single client
+
+// Responses waiting for room in the response ring, in order
+typedef struct {
+    char *json;
+    size_t len;
+} pending_t;
+
+static pending_t *pending;
+static size_t pending_count;
+static size_t pending_cap;
+
+static bool flush_pending()
+{
+    size_t i = 0;
+    while (i < pending_count &&
+           shm_ring_push(g_shm, &g_shm->responses, pending[i].json, (uint32_t)pending[i].len))
+        cJSON_free(pending[i++].json);
+    if (i > 0)
+    {
+        memmove(pending, pending + i, (pending_count - i) * sizeof(*pending));
+        pending_count -= i;
+    }
+    return pending_count == 0;
+}
+
+// The error sent in place of a message too large for the ring, so the
+// client is not left waiting for the request. NULL for a notification.
+static char *too_large_error(const char *json, size_t len)
+{
+    cJSON *message = cJSON_ParseWithLength(json, len);
+    cJSON *id = cJSON_DetachItemFromObjectCaseSensitive(message, "id");
+    cJSON_Delete(message);
+    if (!id)
+        return NULL;
+    cJSON *e = err(id, MCP_INTERNAL_ERROR, "Response too large for the shared memory ring");
+    char *s = cJSON_PrintUnformatted(e);
+    cJSON_Delete(e);
+    return s;
+}
+
+static void shm_write(mcp_conn_t *conn, char *json, size_t len)
+{
+    (void)conn; // a single client
+    if (len > MCP_SHM_RING_SIZE / 2 - 8)
+    {
+        fprintf(stderr, "Response of %zu bytes doesn't fit in the shared memory ring\n", len);
+        char *e = too_large_error(json, len);
+        cJSON_free(json);
+        if (!e)
+            return;
+        json = e;
+        len = strlen(e);
+    }
+    if (pending_count == 0 && shm_ring_push(g_shm, &g_shm->responses, json, (uint32_t)len))
+    {
+        cJSON_free(json);
+        return;
+    }
+    // Ring full, the client is not reading: keep it for a later tick
+    if (pending_count == pending_cap)
+    {
+        size_t cap = pending_cap ? pending_cap * 2 : 16;
+        pending_t *p = realloc(pending, cap * sizeof(*p));
+        if (!p)
+        {
+            cJSON_free(json); // out of memory, the response is lost
+            return;
+        }
+        pending = p;
+        pending_cap = cap;
+    }
+    pending[pending_count].json = json;
+    pending[pending_count].len = len;
+    pending_count++;
+}
+
+static bool shm_notify(mcp_conn_t *conn, char *json, size_t len)
+{
+    shm_write(conn, json, len); // same ring, in order with the response
+    return true;
+}
+
+static void shm_complete(mcp_conn_t *conn)
+{
+    (void)conn; // nothing to send without a response
+}
+
+void process_shm()
+{
+    // Requests are not read while responses are still waiting, the
+    // client is throttled by its request ring
+    if (!flush_pending())
+        return;
+
+    uint32_t len;
+    const char *m;
+    for (;;)
+    {
+        errno = 0;
+        if ((m = shm_ring_peek(g_shm, &g_shm->requests, &len)) == NULL)
+        {
+            if (errno == EPROTO)
+                fprintf(stderr, "Corrupted shared memory request ring, requests dropped\n");
+            break;
+        }
+        // Parsed in place, the record is released before dispatch
+        cJSON_ParseError error;
+        cJSON *root = cJSON_ParseWithError(m, len, &error);
+        shm_ring_pop(&g_shm->requests, len);
+
+        mcp_conn_t conn = { .transport = &transport_shm, .fd = -1, .session = g_session };
+        if (!root)
+            dispatch_parse_error(&conn, &error);
+        else
+            dispatch_request(&conn, root);
+        if (pending_count > 0)
+            break;
+    }
+}
+
+int init_shm()
+{
+    g_shm = shm_map(MCP_SHM_NAME, true);
+    if (!g_shm)
+    {
+        fprintf(stderr, "Failed to create shared memory %s: %s\n", MCP_SHM_NAME, strerror(errno));
+        return(1);
+    }
+    g_session = session_new();
+    fprintf(stderr, "MCP shared memory ready in %s\n", MCP_SHM_NAME);
+    return(0);
+}
+
+void end_shm()
+{
+    for (size_t i = 0; i < pending_count; i++)
+        cJSON_free(pending[i].json);
+    free(pending);
+    pending = NULL;
+    pending_count = pending_cap = 0;
+
+    shm_unmap(g_shm);
+    g_shm = NULL;
+    session_release(g_session);
+    g_session = NULL;
+    shm_unlink(MCP_SHM_NAME);
+}
+
+const transport_t transport_shm = {
+    .name = "shm",
+    .init = init_shm,
+    .process = process_shm,
+    .end = end_shm,
+    .write = shm_write,
+    .notify = shm_notify,
+    .complete = shm_complete,
+};
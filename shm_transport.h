@@ -0,0 +1,79 @@
+#ifndef shm_transport_h
+#define shm_transport_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "transport.h"
+
+/* ===========================
+   Shared memory transport for a local client.
+
+   The server creates a POSIX shared memory object (MCP_SHM_NAME)
+   that a single client maps. It holds a shm_header_t followed by
+   the data of two single producer / single consumer rings:
+   requests (client -> server) and responses (server -> client).
+
+   A ring carries one JSON-RPC message per record:
+   [uint32 length][message][padding to 8 bytes]
+   head and tail are byte counts that only grow, the position in
+   the data is count & (size - 1). A record never wraps: when it
+   doesn't fit before the end, the producer writes SHM_WRAP as
+   length and the record starts again at offset 0. A message can
+   be at most size / 2 - 8 bytes, a larger response is replaced by
+   an MCP_INTERNAL_ERROR error for its request.
+
+   After each record the producer bumps doorbell, and wakes the
+   consumer with FUTEX_WAKE when waiters is not 0.
+   =========================== */
+#ifndef MCP_SHM_NAME
+#define MCP_SHM_NAME "/cmcp"
+#endif
+
+#ifndef MCP_SHM_RING_SIZE
+#define MCP_SHM_RING_SIZE (1024*1024) // bytes per direction, power of two
+#endif
+
+#define SHM_MAGIC 0x504d434d // set once the rings are ready
+#define SHM_VERSION 1
+#define SHM_WRAP 0xffffffffu
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;  // written by the consumer
+    _Alignas(64) _Atomic uint64_t tail;  // written by the producer
+    _Alignas(64) _Atomic uint32_t doorbell; // futex word
+    _Atomic uint32_t waiters;            // consumers sleeping on doorbell
+    uint32_t size;                       // data bytes, power of two
+    uint32_t data_offset;                // from the start of the mapping
+} shm_ring_t;
+
+typedef struct {
+    _Atomic uint32_t magic;
+    uint32_t version;
+    shm_ring_t requests;  // client -> server
+    shm_ring_t responses; // server -> client
+} shm_header_t;
+
+// Map the shared memory object, created and initialized when create is set.
+// Returns NULL on error.
+extern shm_header_t *shm_map(const char *name, bool create);
+extern void shm_unmap(shm_header_t *shm);
+
+// Producer side. Returns false when the ring has no room for the message.
+extern bool shm_ring_push(shm_header_t *shm, shm_ring_t *r, const void *msg, uint32_t len);
+// Consumer side. The next message, read in place until shm_ring_pop(), or NULL.
+// Records the producer corrupted are not returned: the ring is emptied and
+// errno set to EPROTO.
+extern const char *shm_ring_peek(shm_header_t *shm, shm_ring_t *r, uint32_t *len);
+extern void shm_ring_pop(shm_ring_t *r, uint32_t len);
+// Consumer side. Spin for a while, then sleep until a message is pushed or
+// timeout_ms elapsed (-1 waits forever). Returns false on timeout.
+extern bool shm_ring_wait(shm_ring_t *r, int timeout_ms);
+
+extern void process_shm();
+extern int init_shm();
+extern void end_shm();
+
+extern const transport_t transport_shm;
+
+#endif
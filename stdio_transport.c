@@ -1,41 +1,812 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 #include "config.h"
 #include "stdio_transport.h"
 #include "mcp.h"
+#include "queue.h"
+#include "session.h"
 #include "tools.h"
 
+// Size of a read() from stdin, the input buffer only grows beyond it
+// for a Content-Length header block that arrives in pieces
+#ifndef STDIO_CHUNK
+#define STDIO_CHUNK 65536
+#endif
 
-static char *line = NULL;
+// Input not fed to in_stream yet is in[start..end). Messages are parsed
+// while they are read, the buffer never holds a whole one: it is
+// compacted rather than wrapped to keep a header block contiguous.
+static cJSON_Stream *in_stream = NULL;
+static char *in = NULL;
+static size_t in_cap = 0;
+static size_t in_start = 0;
+static size_t in_end = 0;
+static size_t in_scanned = 0; // in[start..scanned) is known to hold no '\n'
+static bool in_eof = false;
+static cJSON *in_root = NULL; // value of the message, only blanks may follow it
+static size_t in_trailing = 0; // offset of a byte after the value that is not blank, 0 when none
+
+static session_t *stdio_session; // of the single client, the same for every request
+
+// Largest accepted message, bigger ones are skipped
+#ifndef STDIO_MSG_MAX
+#define STDIO_MSG_MAX (64*1024*1024)
+#endif
+
+#if defined(MCP_STDIO_CONTENT_LENGTH)
+// Framing state of the message at in_start. Once its header is complete
+// the body is fed to in_stream as it arrives.
+static bool in_body = false;  // the header was read
+static size_t in_size = 0;    // body bytes
+static size_t in_length = 0;  // body bytes still to come
+static size_t in_skip = 0;    // body bytes of a rejected message still to drop
+static bool in_skip_header = false; // dropping a header block that was too long
+static bool in_line_empty = false;  // while skipping: only '\r' since the last '\n'
+
+// Largest header block, a longer one is dropped up to its empty line
+#ifndef STDIO_HEADER_MAX
+#define STDIO_HEADER_MAX 8192
+#endif
+#else
+static size_t in_line = 0; // bytes of the current line fed or scanned
+static bool in_skip_line = false; // dropping the rest of a rejected line
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Responses of one main loop tick are collected here and written
+// together by flush_output() with writev(). They are referenced where
+// cJSON printed them and released once written.
+typedef struct {
+    struct iovec *iov;
+    size_t count;
+    size_t cap;
+} out_buf_t;
+
+static char newline[] = "\n"; // message boundary, the only buffer not released
+
+static out_buf_t out_pending; // appended to by any thread, under out_mu
+static out_buf_t out_flush;   // the batch being flushed by the main loop
+static pthread_mutex_t out_mu = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(MCP_STDIO_WRITER_THREAD)
+// Writer thread: takes the flushed batches and writes them, so a client
+// that reads slowly never blocks dispatch
+static out_buf_t out_queued;  // flushed, not yet taken by the writer
+static out_buf_t out_writing; // owned by the writer
+static pthread_t writer_thr;
+static pthread_mutex_t writer_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cv = PTHREAD_COND_INITIALIZER;
+static bool writer_running;
+#endif
+
+#if defined(MCP_STDIO_WORKERS)
+// Worker threads run tools/call so that a slow tool doesn't hold up the
+// requests after it. Their responses are written as they complete and
+// the client matches them by id.
+static msg_queue_t job_queue;
+static pthread_t worker_thr[MCP_STDIO_WORKERS];
+static pthread_mutex_t job_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cv = PTHREAD_COND_INITIALIZER;
+static bool workers_running;
+static int workers_started;
+#endif
+
+#if !defined(MCP_STDIO_POLL)
+// Reader thread: reads and parses stdin into a queue that the main loop
+// drains, so the host loop never waits for or works on client input
+#define READER_POLL_MS 100 // how often the reader checks for shutdown
+static msg_queue_t stdio_queue;
+static pthread_t reader_thr;
+static _Atomic bool reader_running;
+static _Atomic bool reader_eof;
+#endif
+
+#if defined(MCP_STDIO_WORKERS)
+static bool is_tools_call(const msg_t *msg)
+{
+    const cJSON *method = cJSON_GetObjectItemCaseSensitive(msg->root, "method");
+    return cJSON_IsString(method) && strcmp(method->valuestring, "tools/call") == 0;
+}
+
+static bool post_job(const msg_t *msg)
+{
+    pthread_mutex_lock(&job_mu);
+    bool queued = queue_try_push(&job_queue, msg);
+    if (queued)
+        pthread_cond_signal(&job_cv);
+    pthread_mutex_unlock(&job_mu);
+    return queued;
+}
+
+static void* worker_thread_main(void* arg)
+{
+    (void)arg;
+    msg_t msg;
+    pthread_mutex_lock(&job_mu);
+    for (;;)
+    {
+        while (workers_running && !queue_try_pop(&job_queue, &msg))
+            pthread_cond_wait(&job_cv, &job_mu);
+        if (!workers_running && !queue_try_pop(&job_queue, &msg))
+            break; // stopped and no call left
+        pthread_mutex_unlock(&job_mu);
+        mcp_conn_t conn = { .transport = &transport_stdio, .fd = msg.cfd, .session = stdio_session };
+        dispatch_request(&conn, msg.root);
+        pthread_mutex_lock(&job_mu);
+    }
+    pthread_mutex_unlock(&job_mu);
+    cJSON_ReleaseThreadCache();
+    return NULL;
+}
+#endif
+
+static void deliver(msg_t *msg)
+{
+#if defined(MCP_STDIO_WORKERS)
+    // Run inline when the workers are all busy and their queue is full
+    if (workers_started > 0 && !msg->parse_error && is_tools_call(msg) && post_job(msg))
+        return;
+#endif
+    mcp_conn_t conn = { .transport = &transport_stdio, .fd = msg->cfd, .session = stdio_session };
+    if (msg->parse_error)
+        dispatch_parse_error(&conn,&msg->error);
+    else
+        dispatch_request(&conn,msg->root);
+}
+
+// Report a framing error as a parse error of the message
+static void framing_error(msg_t *msg, const char *reason)
+{
+    msg->cfd = 0;
+    msg->root = NULL;
+    msg->parse_error = true;
+    msg->error.offset = 0;
+    msg->error.reason = reason;
+}
+
+// Report why in_stream failed and make it ready for the next message
+static void stream_error(msg_t *msg)
+{
+    framing_error(msg, NULL);
+    cJSON_StreamGetError(in_stream, &msg->error);
+    cJSON_StreamReset(in_stream);
+}
+
+static void out_release(out_buf_t *b)
+{
+    for (size_t i = 0; i < b->count; i++)
+    {
+        if (b->iov[i].iov_base != newline)
+            cJSON_free(b->iov[i].iov_base);
+    }
+    b->count = 0;
+}
+
+static bool out_reserve(out_buf_t *b, size_t n)
+{
+    if (b->cap - b->count < n)
+    {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap - b->count < n)
+            cap *= 2;
+        struct iovec *p = realloc(b->iov, cap * sizeof(*p));
+        if (!p)
+            return false;
+        b->iov = p;
+        b->cap = cap;
+    }
+    return true;
+}
+
+// Room must have been reserved
+static void out_push(out_buf_t *b, char *data, size_t len)
+{
+    b->iov[b->count].iov_base = data;
+    b->iov[b->count].iov_len = len;
+    b->count++;
+}
+
+// Write a whole batch, a client that went away ends the session
+static void write_all(out_buf_t *b)
+{
+    size_t i = 0, skip = 0; // iov[i] is written up to skip
+    while (i < b->count)
+    {
+        struct iovec first = b->iov[i];
+        b->iov[i].iov_base = (char *)first.iov_base + skip;
+        b->iov[i].iov_len = first.iov_len - skip;
+        size_t cnt = b->count - i < IOV_MAX ? b->count - i : IOV_MAX;
+        ssize_t n = writev(STDOUT_FILENO, &b->iov[i], (int)cnt);
+        b->iov[i] = first;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            atomic_store(&done, 1);
+            break;
+        }
+        size_t written = skip + (size_t)n;
+        while (i < b->count && written >= b->iov[i].iov_len)
+            written -= b->iov[i++].iov_len;
+        skip = written;
+    }
+    out_release(b);
+}
+
+static void stdio_write(mcp_conn_t *conn, char *json, size_t len)
+{
+    (void)conn; // a single client
+    stdio_send(json, len);
+}
+
+// Goes out with the next flush of the main loop, while the tool still
+// runs when it is called by a worker (MCP_STDIO_WORKERS)
+static bool stdio_notify(mcp_conn_t *conn, char *json, size_t len)
+{
+    (void)conn;
+    stdio_send(json, len);
+    return true;
+}
+
+static void stdio_complete(mcp_conn_t *conn)
+{
+    (void)conn; // nothing to send without a response
+}
+
+void stdio_send(char *json, size_t len)
+{
+    pthread_mutex_lock(&out_mu);
+#if defined(MCP_STDIO_CONTENT_LENGTH)
+    char *header = cJSON_malloc(48);
+    if (header && out_reserve(&out_pending, 2))
+    {
+        out_push(&out_pending, header, (size_t)snprintf(header, 48, "Content-Length: %zu\r\n\r\n", len));
+        out_push(&out_pending, json, len);
+    }
+    else
+    {
+        cJSON_free(header);
+        cJSON_free(json); // out of memory, the response is lost
+    }
+#else
+    if (out_reserve(&out_pending, 2))
+    {
+        out_push(&out_pending, json, len);
+        out_push(&out_pending, newline, 1);
+    }
+    else
+        cJSON_free(json); // out of memory, the response is lost
+#endif
+    pthread_mutex_unlock(&out_mu);
+}
+
+static void out_swap(out_buf_t *a, out_buf_t *b)
+{
+    out_buf_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// Hand over the responses of this tick in a single writev()
+static void flush_output()
+{
+    pthread_mutex_lock(&out_mu);
+    out_swap(&out_flush, &out_pending);
+    pthread_mutex_unlock(&out_mu);
+    if (out_flush.count == 0)
+        return;
+#if defined(MCP_STDIO_WRITER_THREAD)
+    pthread_mutex_lock(&writer_mu);
+    if (out_queued.count == 0)
+        out_swap(&out_queued, &out_flush);
+    else if (out_reserve(&out_queued, out_flush.count))
+    {
+        for (size_t i = 0; i < out_flush.count; i++)
+            out_push(&out_queued, out_flush.iov[i].iov_base, out_flush.iov[i].iov_len);
+        out_flush.count = 0;
+    }
+    else
+        out_release(&out_flush); // out of memory, the batch is lost
+    pthread_cond_signal(&writer_cv);
+    pthread_mutex_unlock(&writer_mu);
+#else
+    write_all(&out_flush);
+#endif
+}
+
+#if defined(MCP_STDIO_WRITER_THREAD)
+static void* writer_thread_main(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&writer_mu);
+    for (;;)
+    {
+        while (writer_running && out_queued.count == 0)
+            pthread_cond_wait(&writer_cv, &writer_mu);
+        if (out_queued.count == 0)
+            break; // stopped and everything written
+        out_swap(&out_writing, &out_queued);
+        pthread_mutex_unlock(&writer_mu);
+        write_all(&out_writing);
+        pthread_mutex_lock(&writer_mu);
+    }
+    pthread_mutex_unlock(&writer_mu);
+    return NULL;
+}
+#endif
+
+static bool input_ready(int timeout_ms)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+    return poll(&pfd, 1, timeout_ms) > 0; // also true on hangup, read() then sees EOF
+}
+
+// One read() of whatever is available, waiting at most timeout_ms for it
+static void fill_input(int timeout_ms)
+{
+    if (in_eof || !input_ready(timeout_ms))
+        return;
+
+    size_t want = STDIO_CHUNK;
+    if (in_cap - in_end < want && in_start > 0)
+    {
+        memmove(in, in + in_start, in_end - in_start);
+        in_end -= in_start;
+        in_scanned -= in_start;
+        in_start = 0;
+    }
+    if (in_cap - in_end < want)
+    {
+        size_t cap = in_cap * 2;
+        while (cap - in_end < want)
+            cap *= 2;
+        char *p = realloc(in, cap);
+        if (!p)
+            return;
+        in = p;
+        in_cap = cap;
+    }
+
+    ssize_t n = read(STDIN_FILENO, in + in_end, in_cap - in_end);
+    if (n > 0)
+        in_end += (size_t)n;
+    else if (n == 0 || (errno != EINTR && errno != EAGAIN))
+        in_eof = true;
+}
+
+#if defined(MCP_STDIO_CONTENT_LENGTH)
+// Content-Length of a complete header block, false when it has none
+static bool header_length(const char *h, const char *end, size_t *length)
+{
+    static const char name[] = "Content-Length:";
+    while (h < end)
+    {
+        const char *eol = memchr(h, '\n', (size_t)(end - h));
+        if (!eol)
+            eol = end;
+        if ((size_t)(eol - h) > sizeof(name) - 1 && strncasecmp(h, name, sizeof(name) - 1) == 0)
+        {
+            char *num_end;
+            unsigned long long n = strtoull(h + sizeof(name) - 1, &num_end, 10);
+            if (num_end == h + sizeof(name) - 1)
+                return false;
+            *length = (size_t)n;
+            return true;
+        }
+        h = eol + 1;
+    }
+    return false;
+}
+
+// Frame and parse the next buffered message. Returns false when there
+// is no complete one.
+static bool next_message(msg_t *msg)
+{
+    if (in_skip > 0)
+    {
+        size_t n = in_end - in_start < in_skip ? in_end - in_start : in_skip;
+        in_start += n;
+        in_scanned = in_start;
+        in_skip -= n;
+    }
+
+    while (in_skip_header && in_start < in_end)
+    {
+        // Rest of a header block that was too long, up to its empty line
+        char c = in[in_start++];
+        if (c == '\n')
+        {
+            in_skip_header = !in_line_empty;
+            in_line_empty = true;
+        }
+        else if (c != '\r')
+            in_line_empty = false;
+        in_scanned = in_start;
+    }
+
+    if (in_skip == 0 && !in_skip_header && !in_body)
+    {
+        // The header ends with an empty line
+        char *nl;
+        while ((nl = memchr(in + in_scanned, '\n', in_end - in_scanned)) != NULL)
+        {
+            size_t k = (size_t)(nl - in);
+            in_scanned = k + 1;
+            bool empty = (k == in_start || in[k - 1] == '\n' ||
+                          (in[k - 1] == '\r' && (k - 1 == in_start || in[k - 2] == '\n')));
+            if (!empty)
+                continue;
+            if (k + 1 - in_start <= 2)
+            {
+                in_start = in_scanned; // blank line between messages
+                continue;
+            }
+
+            size_t header = k + 1 - in_start;
+            size_t length;
+            if (header > STDIO_HEADER_MAX)
+            {
+                in_start = in_scanned;
+                framing_error(msg, "header too large");
+                return true;
+            }
+            if (!header_length(in + in_start, in + k, &length))
+            {
+                in_start = in_scanned;
+                framing_error(msg, "missing Content-Length");
+                return true;
+            }
+            if (length > STDIO_MSG_MAX)
+            {
+                in_start = in_scanned;
+                in_skip = length;
+                framing_error(msg, "message too large");
+                return true;
+            }
+            in_start = in_scanned; // the header is not needed any more
+            in_body = true;
+            in_size = in_length = length;
+            break;
+        }
+        if (!in_body && in_end - in_start > STDIO_HEADER_MAX)
+        {
+            // Scanned again by the skip above, from the start of the block
+            in_scanned = in_start;
+            in_skip_header = true;
+            in_line_empty = false;
+            framing_error(msg, "header too large");
+            return true;
+        }
+    }
+
+    if (in_body && !in_root)
+    {
+        size_t n = in_end - in_start < in_length ? in_end - in_start : in_length;
+        size_t used = 0;
+        int status = cJSON_StreamFeed(in_stream, in + in_start, n, &used);
+        in_start = in_scanned = in_start + used;
+        in_length -= used;
+        if (status == cJSON_StreamNeedMore && in_length == 0)
+        {
+            status = cJSON_StreamFinish(in_stream); // top level number or literal
+            if (status == cJSON_StreamNeedMore)
+                status = cJSON_StreamError; // blank body, reported below
+        }
+        if (status == cJSON_StreamComplete)
+            in_root = cJSON_StreamTakeResult(in_stream);
+        else if (status == cJSON_StreamError)
+        {
+            stream_error(msg);
+            if (!msg->error.reason)
+            {
+                msg->error.offset = in_size;
+                msg->error.reason = "empty input";
+            }
+            in_skip = in_length;
+            in_body = false;
+            in_length = 0;
+            return true;
+        }
+    }
+
+    if (in_body && in_root)
+    {
+        // Only blanks may follow the value in the body
+        size_t n = in_end - in_start < in_length ? in_end - in_start : in_length;
+        for (size_t i = 0; i < n && !in_trailing; i++)
+        {
+            if ((unsigned char)in[in_start + i] > ' ')
+                in_trailing = in_size - in_length + i;
+        }
+        in_start = in_scanned = in_start + n;
+        in_length -= n;
+        if (in_length == 0)
+        {
+            if (in_trailing)
+            {
+                cJSON_Delete(in_root);
+                framing_error(msg, "trailing characters");
+                msg->error.offset = in_trailing;
+            }
+            else
+            {
+                msg->cfd = 0;
+                msg->root = in_root;
+                msg->parse_error = false;
+            }
+            in_root = NULL;
+            in_trailing = 0;
+            in_body = false;
+            return true;
+        }
+    }
+
+    if (in_start == in_end)
+        in_start = in_end = in_scanned = 0;
+    return false;
+}
+#else
+// Frame and parse the next buffered message. Returns false when there
+// is no complete one.
+static bool next_message(msg_t *msg)
+{
+    for (;;)
+    {
+        char *nl = memchr(in + in_start, '\n', in_end - in_start);
+        size_t n = nl ? (size_t)(nl - in) - in_start : in_end - in_start;
+        bool line_end = nl != NULL || in_eof; // last message may come without newline
+        if (in_skip_line)
+        {
+            in_start += nl ? n + 1 : n;
+            in_skip_line = (nl == NULL);
+            if (in_skip_line)
+                break;
+            continue;
+        }
+
+        if (!in_root)
+        {
+            size_t used = 0;
+            int status = cJSON_StreamFeed(in_stream, in + in_start, n, &used);
+            in_start += used;
+            in_line += used;
+            n -= used;
+            if (status == cJSON_StreamNeedMore && line_end)
+            {
+                status = cJSON_StreamFinish(in_stream); // top level number or literal
+                if (status == cJSON_StreamNeedMore)
+                {
+                    // Blank line, its whitespace doesn't count in the next one
+                    cJSON_StreamReset(in_stream);
+                    in_line = 0;
+                    if (!nl)
+                        break;
+                    in_start++;
+                    continue;
+                }
+            }
+            if (status == cJSON_StreamNeedMore)
+                break;
+            if (status == cJSON_StreamError)
+            {
+                stream_error(msg);
+                in_line = 0;
+                in_skip_line = true;
+                in_scanned = in_start;
+                return true;
+            }
+            in_root = cJSON_StreamTakeResult(in_stream);
+        }
+
+        // Only blanks may follow the value on its line
+        for (size_t i = 0; i < n && !in_trailing; i++)
+        {
+            if ((unsigned char)in[in_start + i] > ' ')
+                in_trailing = in_line + i;
+        }
+        in_start += n;
+        in_line += n;
+        if (!line_end)
+            break;
+        if (nl)
+            in_start++;
+        if (in_trailing)
+        {
+            cJSON_Delete(in_root);
+            framing_error(msg, "trailing characters");
+            msg->error.offset = in_trailing;
+        }
+        else
+        {
+            msg->cfd = 0;
+            msg->root = in_root;
+            msg->parse_error = false;
+        }
+        in_root = NULL;
+        in_trailing = 0;
+        in_line = 0;
+        in_scanned = in_start;
+        return true;
+    }
+    in_scanned = in_start;
+    if (in_start == in_end)
+        in_start = in_end = in_scanned = 0;
+    return false;
+}
+#endif
+
+#if !defined(MCP_STDIO_POLL)
+static void* reader_thread_main(void* arg)
+{
+    (void)arg;
+    msg_t msg;
+    while (atomic_load(&reader_running) && !in_eof)
+    {
+        fill_input(READER_POLL_MS);
+        while (next_message(&msg))
+        {
+            // Queue full: stop reading, the client is throttled by the pipe
+            while (!queue_try_push(&stdio_queue, &msg))
+            {
+                if (!atomic_load(&reader_running))
+                {
+                    cJSON_Delete(msg.root);
+                    return NULL;
+                }
+                struct timespec ts = {.tv_sec=0, .tv_nsec=1000*1000};
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
+    atomic_store(&reader_eof, in_eof);
+    cJSON_ReleaseThreadCache();
+    return NULL;
+}
+#endif
 
 int init_stdio()
 {
-    // No stdout noise — only valid MCP messages on stdout.
-    setvbuf(stdout, NULL, _IONBF, 0);
+    // Responses are written with write() on STDOUT_FILENO, nothing else
+    // may print to stdout
 
-    line = NULL;
+    stdio_session = session_new(); // the only client, NULL leaves it without state
+    in_cap = STDIO_CHUNK;
+    in = malloc(in_cap);
+    in_start = in_end = in_scanned = 0;
+    in_eof = false;
+    in_stream = cJSON_StreamCreate(STDIO_MSG_MAX);
+    if (!in || !in_stream)
+    {
+        free(in);
+        in = NULL;
+        cJSON_StreamDelete(in_stream);
+        in_stream = NULL;
+        return(1);
+    }
+
+#if defined(MCP_STDIO_WRITER_THREAD)
+    writer_running = true;
+    if (pthread_create(&writer_thr, NULL, writer_thread_main, NULL) != 0)
+    {
+        free(in);
+        in = NULL;
+        cJSON_StreamDelete(in_stream);
+        in_stream = NULL;
+        return(1);
+    }
+#endif
+
+#if defined(MCP_STDIO_WORKERS)
+    queue_init(&job_queue);
+    workers_running = true;
+    for (workers_started = 0; workers_started < MCP_STDIO_WORKERS; workers_started++)
+    {
+        if (pthread_create(&worker_thr[workers_started], NULL, worker_thread_main, NULL) != 0)
+            break; // run with fewer workers
+    }
+#endif
+
+#if !defined(MCP_STDIO_POLL)
+    queue_init(&stdio_queue);
+    atomic_store(&reader_eof, false);
+    atomic_store(&reader_running, true);
+    if (pthread_create(&reader_thr, NULL, reader_thread_main, NULL) != 0)
+    {
+        free(in);
+        in = NULL;
+        cJSON_StreamDelete(in_stream);
+        in_stream = NULL;
+        return(1);
+    }
+#endif
     return(0);
 }
 
 void end_stdio()
 {
-    free(line);
+#if !defined(MCP_STDIO_POLL)
+    atomic_store(&reader_running, false);
+    pthread_join(reader_thr, NULL);
+    msg_t msg;
+    while (queue_try_pop(&stdio_queue, &msg))
+        cJSON_Delete(msg.root);
+#endif
+#if defined(MCP_STDIO_WORKERS)
+    // Calls already accepted are completed and answered
+    pthread_mutex_lock(&job_mu);
+    workers_running = false;
+    pthread_cond_broadcast(&job_cv);
+    pthread_mutex_unlock(&job_mu);
+    for (int i = 0; i < workers_started; i++)
+        pthread_join(worker_thr[i], NULL);
+#endif
+    flush_output();
+#if defined(MCP_STDIO_WRITER_THREAD)
+    pthread_mutex_lock(&writer_mu);
+    writer_running = false;
+    pthread_cond_signal(&writer_cv);
+    pthread_mutex_unlock(&writer_mu);
+    pthread_join(writer_thr, NULL);
+    free(out_queued.iov);
+    free(out_writing.iov);
+    out_queued = out_writing = (out_buf_t){0};
+#endif
+    out_release(&out_pending);
+    free(out_pending.iov);
+    free(out_flush.iov);
+    out_pending = out_flush = (out_buf_t){0};
+    free(in);
+    in = NULL;
+    cJSON_StreamDelete(in_stream);
+    in_stream = NULL;
+    cJSON_Delete(in_root);
+    in_root = NULL;
+    session_release(stdio_session);
+    stdio_session = NULL;
 }
 
 void process_stdio()
 {
-    size_t cap = 0;
-
-    size_t n = getline(&line, &cap, stdin);
-    if (n <= 0)
-    {
+    msg_t msg;
+#if defined(MCP_STDIO_POLL)
+    // Read what is available without blocking and dispatch every complete
+    // message, a burst is drained in one tick
+    fill_input(0);
+    while (next_message(&msg))
+        deliver(&msg);
+    flush_output();
+    if (in_eof)
         atomic_store(&done, 1);
-        return; // EOF
-    }
-    // Trim trailing \r?\n
-    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
-        line[--n] = 0;
-    if (n == 0)
-        return;
-    dispatch(line,0);
-}
\ No newline at end of file
+#else
+    // Check for EOF first so no message pushed before it is missed
+    bool eof = atomic_load(&reader_eof);
+    while (queue_try_pop(&stdio_queue, &msg))
+        deliver(&msg);
+    flush_output();
+    if (eof)
+        atomic_store(&done, 1);
+#endif
+}
+
+const transport_t transport_stdio = {
+    .name = "stdio",
+    .init = init_stdio,
+    .process = process_stdio,
+    .end = end_stdio,
+    .write = stdio_write,
+    .notify = stdio_notify,
+    .complete = stdio_complete,
+};
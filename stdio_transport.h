@@ -1,8 +1,16 @@
 #ifndef stdio_transport_h
 #define stdio_transport_h
 
+#include <stddef.h>
+#include "transport.h"
+
 extern void process_stdio();
 extern int init_stdio();
 extern void end_stdio();
+// Queue a response, written at the end of the current process_stdio().
+// Takes ownership of json, released with cJSON_free() once written.
+extern void stdio_send(char *json, size_t len);
+
+extern const transport_t transport_stdio;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+/* cJSON_ParseWithError and cJSON_Stream report the same error for the same input */
+#include "cJSON.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+/* Invalid texts, each paired with the offset of its first bad byte */
+static const struct
+{
+    const char *json;
+    size_t offset;
+} invalid[] =
+{
+    { "{bad", 1 },
+    { "[1,2", 4 },
+    { "   ", 3 },
+    { "{", 1 },
+    { "[", 1 },
+    { "{\"a\"", 4 },
+    { "{\"a\":", 5 },
+    { "{\"a\":1", 6 },
+    { "{\"a\" 1}", 5 },
+    { "{\"a\":1,}", 7 },
+    { "[1,]", 3 },
+    { "[1 2]", 3 },
+    { "]", 0 },
+    { "tru", 0 },
+    { "truex", 4 },
+    { "nul", 0 },
+    { "\"abc", 4 },
+    { "\"a\\x\"", 2 },
+    { "{} x", 3 },
+    { "[] ]", 3 },
+    { "1 2", 2 },
+    { "\"a\"b", 3 },
+    { "{\"a\":[1,{\"b\":}]}", 13 },
+    { "-", 0 },
+    { "[1e]", 2 },
+    { "\"\\u12\"", 1 },
+    { "{\"a\":1 \"b\":2}", 7 },
+    { "[\"a\" , ]", 7 },
+    { "{\"a\":1,  ", 9 },
+    { "[1, ", 4 },
+    { "{\"a\" ", 5 },
+    { "\"a\\", 3 },
+    { "{1:2}", 1 },
+    { "nulll", 4 },
+};
+
+static const char *valid[] =
+{
+    "{}", " [1, 2] ", "\"a\\u00e9\"", "123", "-1.5e3", "true", "null", "{\"a\":{\"b\":[null]}}\r\n",
+};
+
+/* The text in chunks of chunk_size bytes, then end of input */
+static cJSON *stream_parse(cJSON_Stream *stream, const char *json, size_t chunk_size, cJSON_ParseError *error)
+{
+    size_t length = strlen(json);
+    size_t consumed = 0;
+    int status = cJSON_StreamNeedMore;
+    while ((status == cJSON_StreamNeedMore) && (consumed < length))
+    {
+        size_t chunk = (length - consumed) < chunk_size ? (length - consumed) : chunk_size;
+        size_t used = 0;
+        status = cJSON_StreamFeed(stream, json + consumed, chunk, &used);
+        consumed += used;
+    }
+    if (status == cJSON_StreamComplete)
+    {
+        /* what is left after the value must be blank */
+        size_t offset = consumed;
+        while ((offset < length) && ((unsigned char)json[offset] <= ' '))
+        {
+            offset++;
+        }
+        if (offset < length)
+        {
+            cJSON_Delete(cJSON_StreamTakeResult(stream));
+            error->offset = offset;
+            error->reason = "trailing characters";
+            return NULL;
+        }
+        return cJSON_StreamTakeResult(stream);
+    }
+    if (status == cJSON_StreamNeedMore)
+    {
+        status = cJSON_StreamFinish(stream);
+    }
+    if (status == cJSON_StreamComplete)
+    {
+        return cJSON_StreamTakeResult(stream);
+    }
+    if (!cJSON_StreamGetError(stream, error))
+    {
+        error->offset = length;
+        error->reason = "empty input";
+    }
+    cJSON_StreamReset(stream);
+    return NULL;
+}
+
+int main(void)
+{
+    cJSON_Stream *stream = cJSON_StreamCreate(0);
+    CHECK(stream != NULL);
+
+    for (size_t i = 0; i < 2 * sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        /* all at once, then byte by byte */
+        const char *json = invalid[i / 2].json;
+        size_t offset = invalid[i / 2].offset;
+        cJSON_ParseError whole = { 0, NULL };
+        cJSON_ParseError streamed = { 0, NULL };
+        cJSON *a = cJSON_ParseWithError(json, strlen(json), &whole);
+        cJSON *b = stream_parse(stream, json, (i % 2) ? 1 : strlen(json), &streamed);
+        CHECK(a == NULL);
+        CHECK(b == NULL);
+        cJSON_Delete(a);
+        cJSON_Delete(b);
+        if ((whole.offset != offset) || (streamed.offset != offset))
+        {
+            fprintf(stderr, "%s: offset %zu and %zu, expected %zu\n", json, whole.offset, streamed.offset, offset);
+            failures++;
+        }
+        if ((whole.reason == NULL) || (streamed.reason == NULL) || (strcmp(whole.reason, streamed.reason) != 0))
+        {
+            fprintf(stderr, "%s: \"%s\" and \"%s\"\n", json, whole.reason ? whole.reason : "", streamed.reason ? streamed.reason : "");
+            failures++;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+    {
+        cJSON_ParseError error = { 0, NULL };
+        cJSON *a = cJSON_ParseWithError(valid[i], strlen(valid[i]), &error);
+        cJSON *b = stream_parse(stream, valid[i], 1, &error);
+        CHECK(a != NULL);
+        CHECK(b != NULL);
+        CHECK(cJSON_Compare(a, b, 1));
+        cJSON_Delete(a);
+        cJSON_Delete(b);
+    }
+
+    cJSON_StreamDelete(stream);
+    if (failures)
+        fprintf(stderr, "%d failed\n", failures);
+    return failures != 0;
+}
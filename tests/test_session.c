@@ -0,0 +1,82 @@
+/* Session table, built with MCP_SESSION_MAX 8 (see CMakeLists.txt) */
+#include "session.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+static bool known(const session_t* s) {
+    session_t* found = session_find(s->id, SESSION_ID_LEN);
+    session_release(found);
+    return found != NULL;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { 0, ms * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+// Sessions flooding a full table don't lock out a new initialize, and
+// push out each other before a session that is in use
+static void full_table(void) {
+    session_t* used = session_create();
+    CHECK(used != NULL);
+    CHECK(known(used));
+
+    session_t* flood[MCP_SESSION_MAX];
+    for (int i = 0; i < MCP_SESSION_MAX; i++) {
+        flood[i] = session_create();
+        CHECK(flood[i] != NULL);
+    }
+    session_t* fresh = session_create();
+    CHECK(fresh != NULL);
+    CHECK(known(fresh));
+    CHECK(known(used));
+
+    // two flood sessions made room, for the last of them and for fresh
+    int left = 0;
+    for (int i = 0; i < MCP_SESSION_MAX; i++) {
+        left += known(flood[i]);
+        session_release(flood[i]);
+    }
+    CHECK(left == MCP_SESSION_MAX - 2);
+    session_release(fresh);
+    session_release(used);
+    session_clear();
+}
+
+// When every session was used, the least recently used one goes
+static void all_used(void) {
+    session_t* s[MCP_SESSION_MAX];
+    for (int i = 0; i < MCP_SESSION_MAX; i++) {
+        s[i] = session_create();
+        CHECK(s[i] != NULL);
+        CHECK(known(s[i]));
+        sleep_ms(2);
+    }
+    CHECK(known(s[0])); // s[1] is now the least recently used
+
+    session_t* fresh = session_create();
+    CHECK(fresh != NULL);
+    CHECK(known(fresh));
+    CHECK(!known(s[1]));
+    CHECK(known(s[0]));
+
+    for (int i = 0; i < MCP_SESSION_MAX; i++)
+        session_release(s[i]);
+    session_release(fresh);
+    session_clear();
+}
+
+int main(void) {
+    full_table();
+    all_used();
+    if (failures) fprintf(stderr, "%d failed\n", failures);
+    return failures != 0;
+}
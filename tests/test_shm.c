@@ -0,0 +1,100 @@
+/* Shared memory transport, built with a 4 KiB ring (see CMakeLists.txt) */
+#include "mcp.h"
+#include "shm_transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+// The only tool: returns a text of result_size bytes
+static size_t result_size;
+
+cJSON *handle_tools_call(cJSON *id, cJSON *params)
+{
+    (void)params;
+    char *text = malloc(result_size + 1);
+    memset(text, 'x', result_size);
+    text[result_size] = 0;
+    cJSON *res = ok(id, create_result_text(text));
+    free(text);
+    return res;
+}
+
+// Send a tools/call from the client side and read the response
+static cJSON *call(shm_header_t *client, int id)
+{
+    char request[128];
+    int n = snprintf(request, sizeof(request),
+                     "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"tools/call\",\"params\":{\"name\":\"t\"}}", id);
+    if (!shm_ring_push(client, &client->requests, request, (uint32_t)n))
+        return NULL;
+    process_shm();
+
+    uint32_t len;
+    const char *m = shm_ring_peek(client, &client->responses, &len);
+    if (!m)
+        return NULL;
+    cJSON *response = cJSON_ParseWithLength(m, len);
+    shm_ring_pop(&client->responses, len);
+    return response;
+}
+
+static int code_of(const cJSON *response)
+{
+    const cJSON *code = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(response, "error"), "code");
+    return cJSON_IsNumber(code) ? code->valueint : 0;
+}
+
+static int id_of(const cJSON *response)
+{
+    const cJSON *id = cJSON_GetObjectItemCaseSensitive(response, "id");
+    return cJSON_IsNumber(id) ? id->valueint : -1;
+}
+
+int main(void)
+{
+    if (init_shm() != 0)
+        return 1;
+    shm_header_t *client = shm_map(MCP_SHM_NAME, false);
+    CHECK(client != NULL);
+    if (!client)
+    {
+        end_shm();
+        return 1;
+    }
+
+    // fits in the ring
+    result_size = 100;
+    cJSON *r = call(client, 1);
+    CHECK(r != NULL);
+    CHECK(id_of(r) == 1);
+    CHECK(cJSON_GetObjectItemCaseSensitive(r, "result") != NULL);
+    cJSON_Delete(r);
+
+    // larger than half the ring: the client still gets an answer
+    result_size = MCP_SHM_RING_SIZE;
+    r = call(client, 7);
+    CHECK(r != NULL);
+    CHECK(id_of(r) == 7);
+    CHECK(code_of(r) == MCP_INTERNAL_ERROR);
+    cJSON_Delete(r);
+
+    // and the ring keeps working
+    result_size = 10;
+    r = call(client, 8);
+    CHECK(id_of(r) == 8);
+    CHECK(code_of(r) == 0);
+    cJSON_Delete(r);
+
+    shm_unmap(client);
+    end_shm();
+    if (failures)
+        fprintf(stderr, "%d failed\n", failures);
+    return failures != 0;
+}
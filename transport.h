@@ -0,0 +1,48 @@
+#ifndef transport_h
+#define transport_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ===========================
+   A transport receives requests, hands them to dispatch
+   and sends the responses back on the connection the
+   request came from. Several can run at once, they share
+   the tools and the dispatch code.
+   =========================== */
+struct transport;
+struct cJSON;
+struct session;
+
+// The connection a request came from, responses are written to it
+typedef struct mcp_conn {
+    const struct transport *transport;
+    int fd;
+    void *ctx;      // transport data
+    unsigned flags; // transport state
+    struct session *session; // client state, see session.h. NULL when none.
+    bool responded; // write() was called
+} mcp_conn_t;
+
+typedef struct transport {
+    const char *name;
+    int (*init)(void);    // 0 on success
+    void (*process)(void); // dispatch what was received, called by the main loop
+    void (*end)(void);
+    // Send the response to the request on conn. Takes ownership of json,
+    // printed by cJSON and released with cJSON_free() once sent.
+    void (*write)(mcp_conn_t *conn, char *json, size_t len);
+    // Send a notification related to the request on conn, before its
+    // response. Same ownership as write(). Returns false when the
+    // connection can't carry it, json is then released.
+    bool (*notify)(mcp_conn_t *conn, char *json, size_t len);
+    // Optional, replaces write() when set: print the response in pieces
+    // (cJSON_PrintStreamed()) and send each one as it is printed. Returns
+    // false when it was not sent, write() then gets an error response.
+    bool (*stream)(mcp_conn_t *conn, const struct cJSON *response);
+    // The request on conn is finished, called once after write() or
+    // without it when there is no response (notification)
+    void (*complete)(mcp_conn_t *conn);
+} transport_t;
+
+#endif
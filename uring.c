@@ -0,0 +1,212 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(uring_t *r, unsigned entries)
+{
+    memset(r, 0, sizeof(*r));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_COOP_TASKRUN;
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0)
+        return -errno;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (r->cq_len > r->sq_len)
+            r->sq_len = r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_ptr = r->sq_ptr;
+    else
+    {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED)
+            goto fail;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = r->sq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sq_local_tail = *r->sq_tail;
+    char *cq = r->cq_ptr;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail:;
+    int err = -errno;
+    uring_exit(r);
+    return err;
+}
+
+void uring_exit(uring_t *r)
+{
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_len);
+    if (r->sq_ptr && r->sq_ptr != MAP_FAILED)
+        munmap(r->sq_ptr, r->sq_len);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+unsigned uring_sq_space(uring_t *r)
+{
+    unsigned head = atomic_load_explicit((_Atomic unsigned *)r->sq_head, memory_order_acquire);
+    return r->sq_entries - (r->sq_local_tail - head);
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *r)
+{
+    if (uring_sq_space(r) == 0)
+    {
+        if (uring_submit_and_wait(r, 0) < 0 || uring_sq_space(r) == 0)
+            return NULL;
+    }
+    unsigned index = r->sq_local_tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *r, unsigned wait_nr)
+{
+    atomic_store_explicit((_Atomic unsigned *)r->sq_tail, r->sq_local_tail, memory_order_release);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    for (;;)
+    {
+        // Everything published and not consumed yet by the kernel
+        unsigned to_submit = r->sq_local_tail - atomic_load_explicit((_Atomic unsigned *)r->sq_head, memory_order_acquire);
+        int n = sys_enter(r->fd, to_submit, wait_nr, flags);
+        if (n >= 0)
+            return n;
+        if (errno != EINTR)
+            return -errno;
+    }
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *r)
+{
+    unsigned head = *r->cq_head;
+    if (head == atomic_load_explicit((_Atomic unsigned *)r->cq_tail, memory_order_acquire))
+        return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *r)
+{
+    atomic_store_explicit((_Atomic unsigned *)r->cq_head, *r->cq_head + 1, memory_order_release);
+}
+
+int uring_bufs_init(uring_t *r, uring_bufs_t *b, uint16_t group, unsigned count, unsigned size)
+{
+    memset(b, 0, sizeof(*b));
+    b->ring_len = count * sizeof(struct io_uring_buf);
+    b->ring = mmap(NULL, b->ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->ring == MAP_FAILED)
+    {
+        b->ring = NULL;
+        return -errno;
+    }
+    b->data = mmap(NULL, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->data == MAP_FAILED)
+    {
+        int err = -errno;
+        munmap(b->ring, b->ring_len);
+        b->ring = NULL;
+        b->data = NULL;
+        return err;
+    }
+    b->count = count;
+    b->size = size;
+    b->group = group;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)b->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        int err = -errno;
+        uring_bufs_free(NULL, b);
+        return err;
+    }
+    for (unsigned i = 0; i < count; i++)
+        uring_bufs_recycle(b, i);
+    return 0;
+}
+
+void uring_bufs_free(uring_t *r, uring_bufs_t *b)
+{
+    if (r && b->ring)
+    {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = b->group;
+        sys_register(r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (b->data)
+        munmap(b->data, (size_t)b->count * b->size);
+    if (b->ring)
+        munmap(b->ring, b->ring_len);
+    memset(b, 0, sizeof(*b));
+}
+
+char *uring_buf(uring_bufs_t *b, unsigned id)
+{
+    return b->data + (size_t)id * b->size;
+}
+
+void uring_bufs_recycle(uring_bufs_t *b, unsigned id)
+{
+    struct io_uring_buf *buf = &b->ring->bufs[b->tail & (b->count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(b, id);
+    buf->len = b->size;
+    buf->bid = (uint16_t)id;
+    b->tail++;
+    // The tail shares its place with the first entry's resv field
+    atomic_store_explicit((_Atomic uint16_t *)&b->ring->tail, b->tail, memory_order_release);
+}
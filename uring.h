@@ -0,0 +1,71 @@
+#ifndef uring_h
+#define uring_h
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ===========================
+   Minimal io_uring on raw syscalls (no liburing),
+   for a ring used by a single thread
+   =========================== */
+typedef struct {
+    int fd;
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail; // SQEs up to it are published on submit
+    struct io_uring_sqe *sqes;
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+} uring_t;
+
+// Buffers the kernel picks from for IOSQE_BUFFER_SELECT reads
+typedef struct {
+    struct io_uring_buf_ring *ring;
+    char *data;
+    size_t ring_len;
+    unsigned count; // power of two
+    unsigned size;  // bytes per buffer
+    uint16_t group;
+    uint16_t tail;
+} uring_bufs_t;
+
+// 0 on success, -errno on failure
+extern int uring_init(uring_t *r, unsigned entries);
+extern void uring_exit(uring_t *r);
+
+// A cleared SQE, submitting what is queued when the ring is full.
+// NULL when the kernel doesn't accept more.
+extern struct io_uring_sqe *uring_get_sqe(uring_t *r);
+// Free SQE slots, for chains that must go in one submission
+extern unsigned uring_sq_space(uring_t *r);
+// Submit the queued SQEs and wait for wait_nr completions. Returns the
+// number submitted or -errno.
+extern int uring_submit_and_wait(uring_t *r, unsigned wait_nr);
+
+// Next completion or NULL, released with uring_cqe_seen()
+extern struct io_uring_cqe *uring_peek_cqe(uring_t *r);
+extern void uring_cqe_seen(uring_t *r);
+
+// count must be a power of two. 0 on success, -errno on failure.
+extern int uring_bufs_init(uring_t *r, uring_bufs_t *b, uint16_t group, unsigned count, unsigned size);
+extern void uring_bufs_free(uring_t *r, uring_bufs_t *b);
+extern char *uring_buf(uring_bufs_t *b, unsigned id);
+// Give buffer id back to the kernel
+extern void uring_bufs_recycle(uring_bufs_t *b, unsigned id);
+
+#endif
@@ -0,0 +1,90 @@
+#include "wheel.h"
+
+#include <string.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+// Furthest deadline: one top level slot short of a full turn, so that it
+// never lands in the top slot being cascaded
+#define WHEEL_MAX (((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - ((uint64_t)1 << (WHEEL_BITS * (WHEEL_LEVELS - 1))))
+
+void wheel_init(timer_wheel_t* w, uint64_t now) {
+    memset(w, 0, sizeof(*w));
+    w->now = now;
+}
+
+void wheel_timer_init(wheel_timer_t* t, wheel_fn fn, void* arg) {
+    memset(t, 0, sizeof(*t));
+    t->fn = fn;
+    t->arg = arg;
+}
+
+static void link_timer(timer_wheel_t* w, wheel_timer_t* t) {
+    // The lowest level whose slots still reach expires. Comparing slot
+    // numbers rather than ticks keeps the timer out of the slot being
+    // cascaded, which would only come round again a full turn later.
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           (t->expires >> (WHEEL_BITS * level)) - (w->now >> (WHEEL_BITS * level)) >= WHEEL_SLOTS)
+        level++;
+    wheel_timer_t** slot = &w->slots[level][(t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    t->prev = NULL;
+    t->next = *slot;
+    if (*slot) (*slot)->prev = t;
+    *slot = t;
+    t->slot = slot;
+}
+
+static void unlink_timer(wheel_timer_t* t) {
+    if (t->prev) t->prev->next = t->next;
+    else *t->slot = t->next;
+    if (t->next) t->next->prev = t->prev;
+    t->slot = NULL;
+}
+
+void wheel_add(timer_wheel_t* w, wheel_timer_t* t, uint64_t expires) {
+    if (t->slot) unlink_timer(t);
+    else w->pending++;
+    if (expires <= w->now) expires = w->now + 1; // fires on the next tick
+    if (expires - w->now > WHEEL_MAX) expires = w->now + WHEEL_MAX;
+    t->expires = expires;
+    link_timer(w, t);
+}
+
+void wheel_cancel(timer_wheel_t* w, wheel_timer_t* t) {
+    if (!t->slot) return;
+    unlink_timer(t);
+    w->pending--;
+}
+
+/* Timers of a higher level slot go down to the slots of the time left */
+static void cascade(timer_wheel_t* w, int level) {
+    wheel_timer_t** slot = &w->slots[level][(w->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    wheel_timer_t* t = *slot;
+    *slot = NULL;
+    while (t) {
+        wheel_timer_t* next = t->next;
+        link_timer(w, t);
+        t = next;
+    }
+}
+
+void wheel_advance(timer_wheel_t* w, uint64_t now) {
+    while (w->now < now) {
+        if (w->pending == 0) { // nothing to cascade or fire
+            w->now = now;
+            return;
+        }
+        w->now++;
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if ((w->now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) break;
+            cascade(w, level);
+        }
+        wheel_timer_t** slot = &w->slots[0][w->now & WHEEL_MASK];
+        while (*slot) {
+            wheel_timer_t* t = *slot;
+            unlink_timer(t);
+            w->pending--;
+            t->fn(t, t->arg);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef wheel_h
+#define wheel_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ===========================
+   Hierarchical timing wheel for deadlines of many connections.
+
+   Level 0 has one slot per tick, each level above one slot per
+   64 slots of the level below. Adding and cancelling a timer
+   is O(1). When the time moves past a slot of a higher level its
+   timers are cascaded down, so each one is moved at most
+   WHEEL_LEVELS - 1 times before it fires. Not thread safe: a
+   wheel belongs to the thread that advances it.
+   =========================== */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1u << WHEEL_BITS)
+#define WHEEL_LEVELS 4 // deadlines up to about 2^24 ticks ahead, longer ones are clamped
+
+struct wheel_timer;
+typedef void (*wheel_fn)(struct wheel_timer* t, void* arg);
+
+typedef struct wheel_timer {
+    struct wheel_timer* prev;
+    struct wheel_timer* next;
+    struct wheel_timer** slot; // NULL when not pending
+    uint64_t expires;          // tick
+    wheel_fn fn;
+    void* arg;
+} wheel_timer_t;
+
+typedef struct {
+    uint64_t now; // tick
+    size_t pending;
+    wheel_timer_t* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+} timer_wheel_t;
+
+extern void wheel_init(timer_wheel_t* w, uint64_t now);
+extern void wheel_timer_init(wheel_timer_t* t, wheel_fn fn, void* arg);
+// (Re)arm t to fire once the wheel reaches tick expires, at the latest
+// on the next advance when it is not in the future
+extern void wheel_add(timer_wheel_t* w, wheel_timer_t* t, uint64_t expires);
+extern void wheel_cancel(timer_wheel_t* w, wheel_timer_t* t);
+static inline bool wheel_timer_pending(const wheel_timer_t* t) { return t->slot != NULL; }
+// Move the time to now and call the timers that expired, which may add
+// or cancel timers from their callback
+extern void wheel_advance(timer_wheel_t* w, uint64_t now);
+
+#endif